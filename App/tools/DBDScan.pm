@@ -0,0 +1,100 @@
+package DBDScan;
+
+##
+## Reading dbd files together with the files they include,
+## shared by expandDBD.pl and bundleDBD.pl.
+##
+## Set @DBDScan::searchpath to the include path and $DBDScan::info
+## to a function getting the info messages before calling scanfile.
+##
+
+use warnings;
+use strict;
+use 5.010;
+
+use File::Basename qw/basename/;
+use File::Spec::Functions qw/catfile/;
+use Exporter qw/import/;
+
+our @EXPORT_OK = qw/finddbd scanfile/;
+
+our @searchpath = ();
+our %lookups = ();   # dbd name => file found in @searchpath
+our %filesDone = (); # base names of files read
+our $info = sub { say STDERR shift };
+
+##
+## Search given dbd file from @searchpath list.
+## If it is not found, return the file name as it is.
+##
+sub finddbd {
+    my $name = shift;
+
+    return $lookups{$name} if exists($lookups{$name});
+    foreach my $dir (@searchpath) {
+        my $fullname = catfile($dir, $name);
+        if ( -f $fullname) {
+            return $lookups{$name} = $fullname;
+        }
+    }
+
+    return $lookups{$name} = $name;
+}
+
+##
+## Read a dbd file and call $handler for each line that is not empty,
+## a comment or an include directive.
+## File after "include" directive is read in too.
+##
+sub scanfile {
+    my $name = shift;     # dbd file to read
+    my $handler = shift;  # called with each line
+    my $includer = shift; # dbd file and lineno where this dbd file is included.
+    my $lineno = shift;   # they are undef for files from command line.
+
+    my $base = basename($name);
+
+    if (exists($filesDone{$base})) {
+        if ($includer) {
+            $info->("Info: skipping duplicate file $name included from $includer line $lineno");
+        }
+        else {
+            $info->("Info: skipping duplicate file $name from command line");
+        }
+        return 1;
+    }
+
+    if ($base ne "dbCommon.dbd") {
+        $filesDone{$base} = 1;
+    }
+
+    my $fh;
+    if (!(open $fh, "<", finddbd($name))) {
+        if ($includer) {
+            say STDERR "ERROR: file $name not found in path \"@searchpath\" called from $includer line $lineno";
+        }
+        else {
+            say STDERR "ERROR: file $name not found in path \"@searchpath\"";
+        }
+        return 0;
+    }
+
+    foreach (my $n=1;<$fh>;$n++) {
+        chomp;
+
+        if (/^[ \t]*(#|%|$)/) {
+            # skip
+        }
+        elsif (/include[ \t]+"?([^"]*)"?/) {
+            return 0 unless scanfile($1, $handler, $name, $n);
+        }
+        else {
+            $handler->($_);
+        }
+    }
+    close $fh;
+
+    return 1;
+}
+
+1;
@@ -0,0 +1,112 @@
+#!/usr/bin/env perl
+
+##
+## Merge the dbd files of a set of modules into one dbd bundle
+## which require can load with a single dbLoadDatabase call.
+##
+## Input are lists with lines "<module> <version> <release> <dbdfile>",
+## as written by require to $REQUIRE_DBD_BUNDLE.modules.
+## The bundle starts with a header
+## "#!module <module> <version> <release> <mtime> <dbdfile>" for each module,
+## which require uses to check if the bundle matches.
+## Definitions of menus, record types and other dbd statements found
+## in more than one file are written only once.
+##
+
+use warnings;
+use strict;
+use 5.010;
+
+use FindBin;
+use lib $FindBin::RealBin;
+use DBDScan qw/finddbd scanfile/;
+
+my $quiet = 0;
+my $output;
+my %defsDone = ();
+my @listsInput = ();
+my %modules = ();
+my @moduleOrder = ();
+my @lines = ();
+my @body = ();
+
+while (@ARGV) {
+    my $arg = shift @ARGV;
+    if ($arg eq "-q") { $quiet = 1; }
+    elsif ($arg eq "-o") { $output = shift @ARGV; }
+    elsif ($arg =~ /^-I$/) { push @DBDScan::searchpath, shift @ARGV; }
+    elsif ($arg =~ /^-I(.*)$/) { push @DBDScan::searchpath, $1; }
+    else { push @listsInput, $arg; }
+}
+
+die "usage: $0 [-q] [-I dir] -o bundle.dbd module-list...\n" unless $output && @listsInput;
+
+##
+## Add a complete dbd statement to the bundle unless it has been added before.
+## Block statements are identified by type and name, others by their text.
+##
+sub adddef {
+    my $def = shift;
+    my $key = $def;
+
+    if ($def =~ /^[ \t]*(menu|recordtype|breaktable)[ \t]*\([ \t]*"?([^" \t)]+)"?/) {
+        $key = "$1($2)";
+    }
+    else {
+        $key =~ s/[ \t"]//g;
+    }
+    if (exists($defsDone{$key})) {
+        return;
+    }
+    $defsDone{$key} = 1;
+    push @body, $def;
+}
+
+foreach my $list (@listsInput) {
+    my $fh;
+    open $fh, "<", $list or die "ERROR: cannot read module list $list: $!\n";
+    while (<$fh>) {
+        chomp;
+        next if /^[ \t]*(#|$)/;
+        my ($module, $version, $release, $dbd) = split(" ", $_, 4);
+        die "ERROR: bad line \"$_\" in $list\n" unless defined $dbd;
+        # the last entry for a module wins
+        push @moduleOrder, $module unless exists($modules{$module});
+        $modules{$module} = [$version, $release, $dbd];
+    }
+    close $fh;
+}
+
+$DBDScan::info = sub { say STDERR shift unless $quiet };
+
+foreach my $module (@moduleOrder) {
+    my ($version, $release, $dbd) = @{$modules{$module}};
+    my @st = stat(finddbd($dbd)) or die "ERROR: cannot read $dbd: $!\n";
+    # require checks the dbd file modification time before using the bundle
+    $modules{$module} = [$version, $release, $st[9], $dbd];
+    exit 1 unless scanfile($dbd, sub { push @lines, shift });
+}
+
+my $block = "";
+my $depth = 0;
+foreach (@lines) {
+    $block .= "$_\n";
+    $depth += tr/{//;
+    $depth -= tr/}//;
+    next if $depth > 0;
+    # block statements may have the { on a following line
+    next if $block =~ /^[ \t]*(menu|recordtype|breaktable)\b/ && $block !~ /\{/;
+    adddef($block);
+    $block = "";
+    $depth = 0;
+}
+
+my $out;
+open $out, ">", "$output.tmp" or die "ERROR: cannot write $output.tmp: $!\n";
+foreach my $module (@moduleOrder) {
+    say $out "#!module $module @{$modules{$module}}";
+}
+print $out @body;
+close $out or die "ERROR: cannot write $output.tmp: $!\n";
+rename "$output.tmp", $output or die "ERROR: cannot rename $output.tmp to $output: $!\n";
+say STDERR "Info: bundled ", scalar(@moduleOrder), " modules into $output" unless $quiet;
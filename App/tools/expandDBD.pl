@@ -4,21 +4,25 @@ use warnings;
 use strict;
 use 5.010;
 
-use File::Basename qw/basename/;
 use File::Spec::Functions qw/catfile/;
+use Digest::MD5;
+use FindBin;
+use lib $FindBin::RealBin;
+use DBDScan qw/finddbd scanfile/;
 
 my $epicsversion = 0x030E0000; # 3.14
 my $quiet = 0;
-my @searchpath = ();
-my %filesDone = ();
+my $cachedir;
 my @filesInput = ();
+my @messages = (); # info messages, repeated when the cache is used
 
 while (@ARGV) {
     my $arg = shift @ARGV;
     if ($arg =~ /^-(\d+(.\d+){0,3})$/) { $epicsversion = parseVersion($1); }
     elsif ($arg eq "-q") { $quiet = 1; }
-    elsif ($arg =~ /^-I$/) { push @searchpath, shift @ARGV; }
-    elsif ($arg =~ /^-I(.*)$/) { push @searchpath, $1; }
+    elsif ($arg eq "-c") { $cachedir = shift @ARGV; }
+    elsif ($arg =~ /^-I$/) { push @DBDScan::searchpath, shift @ARGV; }
+    elsif ($arg =~ /^-I(.*)$/) { push @DBDScan::searchpath, $1; }
     else { push @filesInput, $arg; }
 }
 
@@ -39,84 +43,120 @@ sub parseVersion {
     return $vh;
 }
 
+sub info {
+    my $message = shift;
+    push @messages, $message;
+    say STDERR $message unless $quiet;
+}
+$DBDScan::info = \&info;
+
 ##
-## Search given dbd file from @searchpath list.
-## If it is not found, return the file name as it is.
-## 
-sub finddbd {
-    my $name = shift;
+## Dump the lines of the dbd files to stdout,
+## converting registrar, variable and function for 3.13.
+##
+sub expandline {
+    local $_ = shift;
 
-    foreach my $dir (@searchpath) {
-        my $fullname = catfile($dir, $name);
-        if ( -f $fullname) {
-            return $fullname;
-        }
+    if (/(registrar|variable|function)[ \t]*\([ \t]*"?([a-zA-Z0-9_]+)"?[ \t]*\)/) {
+        say "$1($2)" if $epicsversion > 0x030D0000; # 3.13
+    }
+    elsif (/variable[ \t]*\([ \t]*"?([a-zA-Z0-9_]+)"?[ \t]*,[ \t]*"?([a-zA-Z0-9_]+)"?[ \t]*\)/) {
+        say "variable($1,$2)" if $epicsversion > 0x030D0000; # 3.13
+    }
+    else {
+        say;
     }
-
-    return $name;
 }
 
 ##
-## Read a dbd file and dump its contents to stdout.
-## File after "include" directive is read in too.
-## 
-sub scanfile {
-    my $name = shift; # dbd file to read
-    my $includer = shift; # dbd file and lineno where this dbd file is included.
-    my $lineno = shift;   # they are undef for files from command line.
-
-    my $base = basename($name);
-
-    if (exists($filesDone{$base})) {
-        if (!$quiet) {
-            if ($includer) {
-                say STDERR "Info: skipping duplicate file $name included from $includer line $lineno";
-            }
-            else {
-                say STDERR "Info: skipping duplicate file $name from command line";
-            }
-        }
-        return 1;
-    }
+## Expansion cache, shared by all architectures of one EPICS version.
+## An entry is named after the EPICS version, search path and the
+## names and content hashes of the input files. It records all files read,
+## with the path found for each name, so that a hit does not parse any file.
+## A file whose mtime or size changed is hashed again to check the entry.
+## Each name is looked up again in the include path (only stat calls),
+## so that a new file of the same name in an earlier directory is noticed.
+##
+sub filehash {
+    my $file = shift;
+    open my $fh, "<", $file or return "-";
+    binmode $fh;
+    return Digest::MD5->new->addfile($fh)->hexdigest;
+}
 
-    if ($base ne "dbCommon.dbd") {
-        $filesDone{$base} = 1;
+sub cachekey {
+    my $ctx = Digest::MD5->new;
+    $ctx->add(join("\0", sprintf("%08X", $epicsversion), @DBDScan::searchpath), "\0");
+    foreach my $name (@filesInput) {
+        $ctx->add($name, "\0", filehash(finddbd($name)), "\0");
     }
+    return $ctx->hexdigest;
+}
 
+sub readcache {
+    my $entry = shift;
     my $fh;
-    if (!(open $fh, "<", finddbd($name))) {
-        if ($includer) {
-            say STDERR "ERROR: file $name not found in path \"@searchpath\" called from $includer line $lineno";
-        }
-        else {
-            say STDERR "ERROR: file $name not found in path \"@searchpath\"";
-        }
-        return 0;
-    }
-
-    foreach (my $n=1;<$fh>;$n++) {
+    open $fh, "<", $entry or return 0;
+    my @info = ();
+    while (<$fh>) {
         chomp;
-
-        if (/^[ \t]*(#|%|$)/) {
-            # skip
+        last if $_ eq "--";
+        if (/^dep (\S+) (\d+) (\d+) (.*)$/) {
+            my ($hash, $mtime, $size, $file) = ($1, $2, $3, $4);
+            my @st = stat($file);
+            next if @st && $st[9] == $mtime && $st[7] == $size;
+            return 0 if filehash($file) ne $hash;
         }
-        elsif (/include[ \t]+"?([^"]*)"?/) {
-            return 0 unless scanfile($1, $name, $n);
+        elsif (/^lookup ([^\t]*)\t(.*)$/) {
+            return 0 if finddbd($1) ne $2;
         }
-        elsif (/(registrar|variable|function)[ \t]*\([ \t]*"?([a-zA-Z0-9_]+)"?[ \t]*\)/) {
-            say "$1($2)" if $epicsversion > 0x030D0000; # 3.13
-        }
-        elsif (/variable[ \t]*\([ \t]*"?([a-zA-Z0-9_]+)"?[ \t]*,[ \t]*"?([a-zA-Z0-9_]+)"?[ \t]*\)/) {
-            say "variable($1,$2)" if $epicsversion > 0x030D0000; # 3.13
-        }
-        else {
-            say;
+        elsif (/^info (.*)$/) {
+            push @info, $1;
         }
     }
-
+    local $/;
+    my $output = <$fh>;
+    return 0 unless defined $output;
+    if (!$quiet) {
+        say STDERR foreach @info;
+    }
+    print $output;
     return 1;
 }
 
+sub writecache {
+    my ($entry, $output) = @_;
+    mkdir $cachedir;
+    my $fh;
+    open $fh, ">", "$entry.$$" or return;
+    my %seen = ();
+    foreach my $file (grep { !$seen{$_}++ } values %DBDScan::lookups) {
+        my @st = stat($file) or next;
+        say $fh "dep ", filehash($file), " $st[9] $st[7] $file";
+    }
+    foreach my $name (sort keys %DBDScan::lookups) {
+        say $fh "lookup $name\t$DBDScan::lookups{$name}";
+    }
+    say $fh "info $_" foreach @messages;
+    say $fh "--";
+    print $fh $output;
+    close $fh and rename "$entry.$$", $entry or unlink "$entry.$$";
+}
+
+my $entry;
+if ($cachedir) {
+    $entry = catfile($cachedir, cachekey());
+    exit 0 if readcache($entry);
+}
+
+my $output = "";
+my $outfh;
+open $outfh, ">", \$output;
+my $stdout = select $outfh;
 foreach my $name (@filesInput) {
-    exit 1 unless scanfile($name);
+    exit 1 unless scanfile($name, \&expandline);
 }
+select $stdout;
+close $outfh;
+print $output;
+writecache($entry, $output) if $entry;
@@ -7,6 +7,9 @@ use 5.010;
 use File::Glob qw/bsd_glob/;
 use IPC::Open3 qw/open3/;
 use Symbol qw/gensym/;
+use Cwd qw/getcwd/;
+use Digest::MD5 qw/md5_hex/;
+use Time::HiRes qw/time/;
 
 my $version;
 my $tag;
@@ -15,6 +18,10 @@ my $branch;
 my $commit;
 my $remotetagcommit;
 my $debug = 0;
+my $timing = 0;
+# Re-use a cached version for this long (seconds) if nothing has changed.
+# Set GETVERSION_CACHE_AGE=0 to disable the cache.
+my $cacheage = $ENV{GETVERSION_CACHE_AGE} // 600;
 
 # Check all files in top directory and all files specified explicitly in subdirectories
 my @files =  glob("GNUmakefile makefile Makefile *.c *.cc *.cpp *.h *.dbd *.st *.stt *.gt");
@@ -26,6 +33,8 @@ while (@ARGV) {
     my $arg = shift @ARGV;
     if ($arg eq "-d") {
         $debug = 1;
+    } elsif ($arg eq "-t") {
+        $timing = 1;
     } else {
         push @files, $arg;
     }
@@ -42,6 +51,8 @@ sub check_output {
         say STDERR "\$ $command";
     }
 
+    my $start = time();
+
     # start the child process capturing stdout and stderr
     my $child_pid = open3(undef, $child_stdout, $child_stderr, $command);
 
@@ -77,6 +88,9 @@ sub check_output {
     }
 
     waitpid($child_pid, 0);
+    if ($timing) {
+        say STDERR sprintf("%.3f s: %s", time() - $start, $command);
+    }
     die $error if $?;
     if ($debug) {
         say STDERR $output;
@@ -186,11 +200,118 @@ if ($debug) {
     say STDERR "checking $files";
 }
 
+##
+## Cache of the detected version in the git directory.
+## The key contains everything that can change the result locally:
+## the checked files with their sub-second mtimes and ctimes, inodes and
+## sizes, HEAD, the git index, the refs and the remote-tracking ref of the
+## branch, which "git push" updates. Files replaced within the same second
+## or with a restored mtime still change the key.
+## Other remote changes are covered only by the maximum age.
+## Only real versions are cached, "test" is always checked again, because
+## it may turn into a version by pushing a tag.
+##
+sub find_gitdir {
+    my $dir = getcwd();
+    while ($dir ne "") {
+        my $git = "$dir/.git";
+        if (-d $git) {
+            return $git;
+        }
+        if (-f $git && open(my $fh, "<", $git)) {
+            my $line = <$fh> // "";
+            close $fh;
+            if ($line =~ /^gitdir: *(.*?)\s*$/) {
+                return $1 =~ m{^/} ? $1 : "$dir/$1";
+            }
+        }
+        $dir =~ s{/[^/]*$}{};
+    }
+    return;
+}
+
+sub file_key {
+    my $file = shift;
+    my @st = Time::HiRes::stat($file);
+    return @st ? "$file $st[1] $st[7] $st[9] $st[10]" : "$file -";
+}
+
+# remote-tracking ref of a branch from [branch "<name>"] remote and merge in the git config
+sub upstream_refs {
+    my ($gitdir, $ref) = @_;
+    my ($remote, $merge, $section);
+    my $branch = $ref =~ m{^refs/heads/(.*)} ? $1 : return;
+
+    open(my $fh, "<", "$gitdir/config") or return;
+    while (<$fh>) {
+        if (/^\s*\[(.*)\]/) {
+            $section = $1;
+        } elsif ($section && $section =~ /^branch\s+"\Q$branch\E"$/) {
+            $remote = $1 if /^\s*remote\s*=\s*(\S+)/;
+            $merge = $1 if /^\s*merge\s*=\s*refs\/heads\/(\S+)/;
+        }
+    }
+    close $fh;
+    return unless $remote && $merge;
+    return "refs/remotes/$remote/$merge";
+}
+
+sub cache_key {
+    my $gitdir = shift;
+    my @key = (getcwd(), $files);
+    foreach my $file (@files, "$gitdir/HEAD", "$gitdir/index", "$gitdir/packed-refs") {
+        push @key, file_key($file);
+    }
+    if (open(my $fh, "<", "$gitdir/HEAD")) {
+        my $head = <$fh> // "";
+        close $fh;
+        push @key, $head;
+        if ($head =~ /^ref: *(.*?)\s*$/) {
+            push @key, file_key("$gitdir/$1");
+            push @key, file_key("$gitdir/$_") foreach upstream_refs($gitdir, $1);
+        }
+    }
+    return md5_hex(join("\n", @key));
+}
+
+my $gitdir = $cacheage > 0 ? find_gitdir() : undef;
+my $cachefile;
+my $cachekey;
+if ($gitdir) {
+    my $start = time();
+    $cachekey = cache_key($gitdir);
+    $cachefile = "$gitdir/getVersion." . md5_hex(getcwd());
+    if (open(my $fh, "<", $cachefile)) {
+        my ($key, $cachedversion) = split(/\s+/, <$fh> // "");
+        close $fh;
+        my $age = time() - (stat($cachefile))[9];
+        if ($timing) {
+            say STDERR sprintf("%.3f s: checking cache %s", time() - $start, $cachefile);
+        }
+        if ($key && $key eq $cachekey && $age < $cacheage) {
+            say STDERR "Using cached version $cachedversion from $cachefile" if $debug;
+            say $cachedversion;
+            exit;
+        }
+    }
+}
+
+sub cache_version {
+    my $version = shift;
+    return unless $cachefile && $version ne "test";
+    if (open(my $fh, ">", "$cachefile.$$")) {
+        say $fh "$cachekey $version";
+        close $fh;
+        rename("$cachefile.$$", $cachefile) or unlink("$cachefile.$$");
+    }
+}
+
 eval {
     # fails if git command exits with error
     @statusinfo = check_output("git status --porcelain $files");
     parse_git_output(\@statusinfo);
     if ($version) {
+        # local changes give "test", which is not cached
         say $version;
         exit;
     }
@@ -261,6 +382,7 @@ eval {
         }
     }
 
+    cache_version($version);
     say $version;
     exit;
 };
@@ -36,6 +36,8 @@
 #include "osiFileName.h"
 #include "epicsVersion.h"
 #include "macLib.h"
+#include "require.h"
+#include "requireProbes.h"
 
 #if defined(vxWorks) || defined (_WIN32)
 #include "asprintf.h"
@@ -67,6 +69,7 @@ static int yyerror(char* str);
 
 static char *sub_collect = NULL;
 static char *sub_locals;
+static char *sub_end;
 static char **vars = NULL;
 static char *db_file_name = NULL;
 static int var_count, sub_count;
@@ -81,6 +84,51 @@ static MAC_HANDLE *macHandle = NULL;
 
 int dbTemplateMaxVars = 100;
 
+/* Append to sub_collect at sub_end, so that long rows do not need
+ * to scan the collected string again for each value.
+ */
+static void sub_append(const char *str)
+{
+    size_t len = strlen(str);
+    size_t space = sub_collect + dbTemplateMaxVars * MAX_VAR_FACTOR - 1 - sub_end;
+
+    if (len > space) {
+        fprintf(stderr, "dbLoadTemplate: Too many or too long macros, line %d. "
+            "Increase dbTemplateMaxVars.\n", line_num);
+        len = space;
+    }
+    memcpy(sub_end, str, len);
+    sub_end += len;
+    *sub_end = '\0';
+}
+
+/* Append macro expanded value, leaving space for reserve more chars */
+static void sub_expand(const char *value, long reserve)
+{
+    long capacity = (long)(dbTemplateMaxVars * MAX_VAR_FACTOR - (sub_end-sub_collect) - reserve);
+
+    if (capacity < 2) {
+        sub_append(value); /* reports the error */
+        return;
+    }
+    macExpandString(macHandle, (char*)value, sub_end, capacity);
+    sub_end += strlen(sub_end);
+}
+
+static void sub_reset(void)
+{
+    *sub_locals = '\0';
+    sub_end = sub_locals;
+}
+
+/* load one row of substitutions */
+static void load_records(void)
+{
+    REQUIRE_PROBE_CONTEXT(template_row_start, db_file_name);
+    dbLoadRecords(db_file_name, sub_collect+1);
+    REQUIRE_PROBE_CONTEXT(template_row_end, db_file_name);
+}
+
 %}
 
 %start substitution_file
@@ -117,7 +165,7 @@ global_definitions: GLOBAL O_BRACE C_BRACE
     #ifdef ERROR_STUFF
         fprintf(stderr, "global_definitions: %s\n", sub_collect+1);
     #endif
-        sub_locals += strlen(sub_locals);
+        sub_locals = sub_end;
     }
     ;
 
@@ -207,7 +255,7 @@ pattern_definition: global_definitions
         fprintf(stderr, "pattern_definition: pattern_values empty\n");
         fprintf(stderr, "    dbLoadRecords(%s)\n", sub_collect+1);
     #endif
-        dbLoadRecords(db_file_name, sub_collect+1);
+        load_records();
     }
     | O_BRACE pattern_values C_BRACE
     {
@@ -215,8 +263,8 @@ pattern_definition: global_definitions
         fprintf(stderr, "pattern_definition:\n");
         fprintf(stderr, "    dbLoadRecords(%s)\n", sub_collect+1);
     #endif
-        dbLoadRecords(db_file_name, sub_collect+1);
-        *sub_locals = '\0';
+        load_records();
+        sub_reset();
         sub_count = 0;
     }
     | WORD O_BRACE pattern_values C_BRACE
@@ -230,9 +278,9 @@ pattern_definition: global_definitions
         fprintf(stderr, "pattern_definition:\n");
         fprintf(stderr, "    dbLoadRecords(%s)\n", sub_collect+1);
     #endif
-        dbLoadRecords(db_file_name, sub_collect+1);
+        load_records();
         dbmfFree($1);
-        *sub_locals = '\0';
+        sub_reset();
         sub_count = 0;
     }
     ;
@@ -248,11 +296,11 @@ pattern_value: QUOTE
         fprintf(stderr, "pattern_value: [%d] = \"%s\"\n", sub_count, $1);
     #endif
         if (sub_count < var_count) {
-            strcat(sub_locals, ",");
-            strcat(sub_locals, vars[sub_count]);
-            strcat(sub_locals, "=\"");
-            macExpandString(macHandle, $1, sub_locals+strlen(sub_locals), (long)(dbTemplateMaxVars * MAX_VAR_FACTOR - (sub_locals+strlen(sub_locals)-sub_collect) - 1));
-            strcat(sub_locals, "\"");
+            sub_append(",");
+            sub_append(vars[sub_count]);
+            sub_append("=\"");
+            sub_expand($1, 1);
+            sub_append("\"");
             sub_count++;
         } else {
             fprintf(stderr, "dbLoadTemplate: Too many values given, line %d.\n",
@@ -266,10 +314,10 @@ pattern_value: QUOTE
         fprintf(stderr, "pattern_value: [%d] = %s\n", sub_count, $1);
     #endif
         if (sub_count < var_count) {
-            strcat(sub_locals, ",");
-            strcat(sub_locals, vars[sub_count]);
-            strcat(sub_locals, "=");
-            macExpandString(macHandle, $1, sub_locals+strlen(sub_locals), (long)(dbTemplateMaxVars * MAX_VAR_FACTOR - (sub_locals+strlen(sub_locals)-sub_collect)));
+            sub_append(",");
+            sub_append(vars[sub_count]);
+            sub_append("=");
+            sub_expand($1, 0);
             sub_count++;
         } else {
             fprintf(stderr, "dbLoadTemplate: Too many values given, line %d.\n",
@@ -290,7 +338,7 @@ variable_substitution: global_definitions
         fprintf(stderr, "variable_substitution: variable_definitions empty\n");
         fprintf(stderr, "    dbLoadRecords(%s)\n", sub_collect+1);
     #endif
-        dbLoadRecords(db_file_name, sub_collect+1);
+        load_records();
     }
     | O_BRACE variable_definitions C_BRACE
     {
@@ -298,8 +346,8 @@ variable_substitution: global_definitions
         fprintf(stderr, "variable_substitution:\n");
         fprintf(stderr, "    dbLoadRecords(%s)\n", sub_collect+1);
     #endif
-        dbLoadRecords(db_file_name, sub_collect+1);
-        *sub_locals = '\0';
+        load_records();
+        sub_reset();
     }
     | WORD O_BRACE variable_definitions C_BRACE
     {   /* DEPRECATED SYNTAX */
@@ -312,9 +360,9 @@ variable_substitution: global_definitions
         fprintf(stderr, "variable_substitution:\n");
         fprintf(stderr, "    dbLoadRecords(%s)\n", sub_collect+1);
     #endif
-        dbLoadRecords(db_file_name, sub_collect+1);
+        load_records();
         dbmfFree($1);
-        *sub_locals = '\0';
+        sub_reset();
     }
     ;
 
@@ -328,10 +376,10 @@ variable_definition: WORD EQUALS WORD
     #ifdef ERROR_STUFF
         fprintf(stderr, "variable_definition: %s = %s\n", $1, $3);
     #endif
-        strcat(sub_locals, ",");
-        strcat(sub_locals, $1);
-        strcat(sub_locals, "=");
-        macExpandString(macHandle, $3, sub_locals+strlen(sub_locals), (long)(dbTemplateMaxVars * MAX_VAR_FACTOR - (sub_locals+strlen(sub_locals)-sub_collect)));
+        sub_append(",");
+        sub_append($1);
+        sub_append("=");
+        sub_expand($3, 0);
         dbmfFree($1); dbmfFree($3);
     }
     | WORD EQUALS QUOTE
@@ -339,11 +387,11 @@ variable_definition: WORD EQUALS WORD
     #ifdef ERROR_STUFF
         fprintf(stderr, "variable_definition: %s = \"%s\"\n", $1, $3);
     #endif
-        strcat(sub_locals, ",");
-        strcat(sub_locals, $1);
-        strcat(sub_locals, "=\"");
-        macExpandString(macHandle, $3, sub_locals+strlen(sub_locals), (long)(dbTemplateMaxVars * MAX_VAR_FACTOR - (sub_locals+strlen(sub_locals)-sub_collect) - 1));
-        strcat(sub_locals, "\"");
+        sub_append(",");
+        sub_append($1);
+        sub_append("=\"");
+        sub_expand($3, 1);
+        sub_append("\"");
         dbmfFree($1); dbmfFree($3);
     }
     | QUOTE EQUALS QUOTE
@@ -351,11 +399,11 @@ variable_definition: WORD EQUALS WORD
     #ifdef ERROR_STUFF
         fprintf(stderr, "variable_definition: \"%s\" = \"%s\"\n", $1, $3);
     #endif
-        strcat(sub_locals, ",\"");
-        strcat(sub_locals, $1);
-        strcat(sub_locals, "\"=\"");
-        macExpandString(macHandle, $3, sub_locals+strlen(sub_locals), (long)(dbTemplateMaxVars * MAX_VAR_FACTOR - (sub_locals+strlen(sub_locals)-sub_collect) - 1));
-        strcat(sub_locals, "\"");
+        sub_append(",\"");
+        sub_append($1);
+        sub_append("\"=\"");
+        sub_expand($3, 1);
+        sub_append("\"");
         dbmfFree($1); dbmfFree($3);
     }
     ;
@@ -376,6 +424,28 @@ static int yyerror(char* str)
 
 static int is_not_inited = 1;
 
+struct openInDirArgs {
+    const char* filename;
+    FILE* file;
+};
+
+static size_t openInDir(const char* dirname, size_t dirlen, void* arg)
+{
+    struct openInDirArgs* a = arg;
+    char* filename = NULL;
+
+    if (dirlen == 1 && dirname[0] == '.') return 0; /* we had . already */
+    if (asprintf(&filename, "%.*s/%s", (int)dirlen, dirname, a->filename) < 0)
+    {
+        fprintf(stderr,"dbLoadTemplate: out of memory\n");
+        return 1;
+    }
+    requireStatsAdd(REQUIRE_STAT_FOPEN, 1);
+    a->file = fopen(filename, "r");
+    free(filename);
+    return a->file != NULL;
+}
+
 #ifndef vxWorks
 #define dbLoadTemplate __dbLoadTemplate
 #endif
@@ -384,6 +454,7 @@ int dbLoadTemplate(const char *sub_file, const char *cmd_collect, const char *pa
 {
     FILE *fp;
     int i;
+    long pos;
     char** pairs;
 
     line_num = 1;
@@ -398,31 +469,28 @@ int dbLoadTemplate(const char *sub_file, const char *cmd_collect, const char *pa
         return -1;
     }
 
+    requireStatsAdd(REQUIRE_STAT_FOPEN, 1);
     fp = fopen(sub_file, "r");
     if (!fp && !isAbsPath(sub_file)) {
-        const char *dirname, *end;
-        int dirlen;
-        char* filename;
+        struct openInDirArgs a = { sub_file, NULL };
 
         if (!path || !*path) {
-        path = getenv("EPICS_DB_INCLUDE_PATH");
+            /* use pre-split path maintained by require */
+            foreachPathDir("EPICS_DB_INCLUDE_PATH", openInDir, &a);
         }
-        for(dirname = path; dirname != NULL; dirname = end) {
-            end = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0]);
-            if (end) dirlen = (int)(end++ - dirname);
-            else dirlen = (int)strlen(dirname);
-            if (dirlen == 0) continue; /* ignore empty path elements */
-            if (dirlen == 1 && dirname[0] == '.') continue; /* we had . already */
-            filename = NULL;
-            if (asprintf(&filename, "%.*s/%s", dirlen, dirname, sub_file) < 0)
-            {
-                fprintf(stderr,"dbLoadTemplate: out of memory\n");
-                break;
+        else {
+            const char *dirname, *end;
+            size_t dirlen;
+
+            for(dirname = path; dirname != NULL; dirname = end) {
+                end = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0]);
+                if (end) dirlen = end++ - dirname;
+                else dirlen = strlen(dirname);
+                if (dirlen == 0) continue; /* ignore empty path elements */
+                if (openInDir(dirname, dirlen, &a)) break;
             }
-            fp = fopen(filename, "r");
-            free(filename);
-            if (fp) break;
         }
+        fp = a.file;
     }
     if (!fp) {
         fprintf(stderr, "dbLoadTemplate: error opening sub file %s: %s\n", sub_file, strerror(errno));
@@ -482,17 +550,18 @@ int dbLoadTemplate(const char *sub_file, const char *cmd_collect, const char *pa
         return -1;
     }
     strcpy(sub_collect, ",");
+    sub_end = sub_collect + 1;
 
     if (cmd_collect && *cmd_collect) {
         macParseDefns(macHandle, (char*)cmd_collect, &pairs);
         macInstallMacros(macHandle, pairs);
         free(pairs);
    
-        strcat(sub_collect, cmd_collect);
-        sub_locals = sub_collect + strlen(sub_collect);
+        sub_append(cmd_collect);
+        sub_locals = sub_end;
     } else {
         sub_locals = sub_collect;
-        *sub_locals = '\0';
+        sub_reset();
     }
     var_count = 0;
     sub_count = 0;
@@ -513,6 +582,7 @@ int dbLoadTemplate(const char *sub_file, const char *cmd_collect, const char *pa
     free(vars);
     free(sub_collect);
     vars = NULL;
+    if ((pos = ftell(fp)) > 0) requireStatsAdd(REQUIRE_STAT_BYTES, pos);
     fclose(fp);
     if (db_file_name) {
         dbmfFree(db_file_name);
@@ -2,6 +2,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 
 #include "expr.h"
 
@@ -63,14 +64,19 @@ static int parseValue(const char** pp, long* v)
 
 static long ipow(long base, long exp)
 {
-    long v;
+    unsigned long v = 1, b = base;
     if (exp < 0) return 0;
-    if (exp == 0) return 1;
-    v = base;
-    while (--exp) v *= base; /* optimize this! */
+    while (exp)
+    {
+        if (exp & 1) v *= b;
+        b *= b;
+        exp >>= 1;
+    }
     return v;
 }
 
+#define LONG_BITS ((long)(sizeof(long)*8))
+
 struct {char str[4]; int pr;} ops[] = {
     {"",0},
     {"**",11},
@@ -144,13 +150,20 @@ static int parseSubExpr(const char** pp, long* v, int pr, int o)
             case  0: val = val2; break;
             case  1: val = ipow(val, val2); break;
             case  2: val *= val2; break;
-            case  3: val /= val2; break;
-            case  4: val %= val2; break;
+            case  3:
+            case  4:
+                if (val2 == 0 || (val2 == -1 && val < -LONG_MAX))
+                {
+                    if (exprDebug) printf("\nparseExpr(%d): division by %ld\n", pr, val2);
+                    return -1;
+                }
+                if (o == 3) val /= val2; else val %= val2;
+                break;
             case  5: val += val2; break;
             case  6: val -= val2; break;
-            case  7: val <<= val2; break;
-            case  8: val = (unsigned long)val >> val2; break;
-            case  9: val >>= val2; break;
+            case  7: val = val2 < 0 || val2 >= LONG_BITS ? 0 : (long)((unsigned long)val << val2); break;
+            case  8: val = val2 < 0 || val2 >= LONG_BITS ? 0 : (long)((unsigned long)val >> val2); break;
+            case  9: val = val2 < 0 || val2 >= LONG_BITS ? (val < 0 ? -1 : 0) : val >> val2; break;
             case 10: val = val < val2 ? -1 : val == val2 ? 0 : 1; break;
             case 11: val = val <= val2; break;
             case 12: val = val >= val2; break;
@@ -216,21 +229,28 @@ size_t replaceExpressions(const char* r, char* buffer, size_t buffersize)
 {
     long val;
     char* w = buffer;
+    char* end = buffer + buffersize - 1; /* leave space for the null byte */
     char* s;
+    int n;
 
+    if (buffersize == 0) return 0;
     *w = 0;
-    while (*r)
+    while (*r && w < end)
     {
         s = w;
         if (*r == '"' || *r == '\'')
         {
             /* quoted strings */
             char c = *w++ = *r++;
-            while (*r && *r != c) {
-                if (*r == '\\' && !(*w++ = *r++)) break;
+            while (*r && *r != c && w < end) {
+                if (*r == '\\')
+                {
+                    *w++ = *r++;
+                    if (!*r || w >= end) break;
+                }
                 *w++ = *r++;
             }
-            if (*r) *w++ = *r++;
+            if (*r && w < end) *w++ = *r++;
             *w = 0;
             if (exprDebug) printf("quoted string %s\n", s);
         }
@@ -248,15 +268,34 @@ size_t replaceExpressions(const char* r, char* buffer, size_t buffersize)
                     w--;
                     r = r2;
                 }
-                w += sprintf(w, f , val);
+                n = snprintf(w, end - w + 1, f , val);
+                if (n < 0 || n > end - w)
+                {
+                    /* does not fit */
+                    *w = 0;
+                    return buffersize;
+                }
+                w += n;
                 if (exprDebug) printf("formatted expression %s\n", s);
             }
+            else
+            {
+                /* no valid format or expression: copy the % */
+                *w++ = *r++;
+                *w = 0;
+            }
         }
         else if (parseExpr(&r, &val) == 0)
         {
             /* unformatted expression */
-            w += sprintf(w, "%ld", val);
-            *w = 0;
+            n = snprintf(w, end - w + 1, "%ld", val);
+            if (n < 0 || n > end - w)
+            {
+                /* does not fit */
+                *w = 0;
+                return buffersize;
+            }
+            w += n;
             if (exprDebug) printf("simple expression %s\n", s);
         }
         else if (*r == ',')
@@ -268,14 +307,16 @@ size_t replaceExpressions(const char* r, char* buffer, size_t buffersize)
             /* unquoted string (i.e plain word) */
             do {
                 *w++ = *r++;
-            } while (*r && !strchr("%(\"', \t\n", *r));
+            } while (*r && w < end && !strchr("%(\"', \t\n", *r));
             *w = 0;
             if (exprDebug) printf("plain word '%s'\n", s);
         }
         /* copy space */
-        while (isspace((unsigned char)*r)) *w++ = *r++;
+        while (isspace((unsigned char)*r) && w < end) *w++ = *r++;
         /* terminate */
         *w = 0;
     }
+    *w = 0;
+    if (*r) return buffersize; /* truncated */
     return w - buffer;
 }
@@ -13,6 +13,8 @@ size_t replaceExpressions(const char* source, char* buffer, size_t buffersize);
  * Do not resolve expressions in single or double quoted strings.
  * An expression optionally starts with a integer format such as %x.
  * It consists of integer numbers, operators and parentheses ().
+ * Division by 0 is not resolved.
+ * Returns the length of the result or buffersize if it did not fit.
  */
 
 #ifdef __cplusplus
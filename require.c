@@ -52,12 +52,16 @@ epicsShareFunc int epicsShareAPI iocshCmd(const char *cmd);
 #endif
 #include <epicsExit.h>
 #include <epicsStdio.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
 #include <osiFileName.h>
 #include <epicsExport.h>
 
 #endif
 
 #include "require.h"
+#include "requireProbes.h"
 
 int requireDebug;
 
@@ -183,8 +187,14 @@ int requireDebug;
 
     #include <unistd.h>
     #include <dlfcn.h>
+    #include <time.h>
     #define HMODULE void *
 
+    #ifdef __linux
+        /* This is the Linux link.h, not the EPICS link.h ! */
+        #include <link.h>
+    #endif
+
     #define getAddress(module, name) dlsym(module, name)
 
     #ifdef CYGWIN32
@@ -265,11 +275,11 @@ int requireDebug;
 
 #else
     #include <dirent.h>
-    #define DIR_HANDLE DIR*
-    #define IF_OPEN_DIR(f) if ((dir = opendir(f)))
+    #define DIR_HANDLE struct moduleDir*
+    #define IF_OPEN_DIR(f) if ((dir = openModuleDir(driverdir->fd, module, f)))
     #define DIR_ENTRY struct dirent*
-    #define START_DIR_LOOP while ((errno = 0, direntry = readdir(dir)) != NULL)
-    #define END_DIR_LOOP if (!direntry && errno) fprintf(stderr, "error reading directory %s: %s\n", filename, strerror(errno)); if (dir) closedir(dir);
+    #define START_DIR_LOOP while ((errno = 0, direntry = readModuleDir(dir)) != NULL)
+    #define END_DIR_LOOP if (!direntry && errno) fprintf(stderr, "error reading directory %s: %s\n", filename, strerror(errno)); if (dir) closeModuleDir(dir);
     #ifdef _DIRENT_HAVE_D_TYPE
     #define SKIP_NON_DIR(e) if (e->d_type != DT_DIR && e->d_type != DT_UNKNOWN) continue;
     #else
@@ -301,11 +311,236 @@ const char targetArch[] = T_A;
 #endif
 const char osClass[] = OS_CLASS;
 
+#if defined (__linux)
+/* count relocations of a loaded library, the PLT ones can be bound lazily */
+static void countRelocations(void* handle, unsigned long* nrel, unsigned long* nplt)
+{
+    struct link_map* map;
+    const ElfW(Dyn)* dyn;
+    unsigned long rel = 0, relsz = 0, relent = 0, jmprel = 0, pltsz = 0, pltent = sizeof(ElfW(Rela));
+
+    *nrel = *nplt = 0;
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0 || !map->l_ld) return;
+    for (dyn = map->l_ld; dyn->d_tag != DT_NULL; dyn++)
+    {
+        switch (dyn->d_tag)
+        {
+            case DT_RELA:
+            case DT_REL:      rel = dyn->d_un.d_ptr; break;
+            case DT_RELASZ:
+            case DT_RELSZ:    relsz += dyn->d_un.d_val; break;
+            case DT_RELAENT:
+            case DT_RELENT:   relent = dyn->d_un.d_val; break;
+            case DT_JMPREL:   jmprel = dyn->d_un.d_ptr; break;
+            case DT_PLTRELSZ: pltsz = dyn->d_un.d_val; break;
+            case DT_PLTREL:   pltent = dyn->d_un.d_val == DT_REL ? sizeof(ElfW(Rel)) : sizeof(ElfW(Rela)); break;
+        }
+    }
+    *nplt = pltsz / pltent;
+    *nrel = relent ? relsz / relent : 0;
+    /* some linkers include the PLT relocations in DT_RELSZ, count them only once */
+    if (!(pltsz && jmprel >= rel && jmprel + pltsz <= rel + relsz))
+        *nrel += *nplt;
+}
+#endif
+
+/* requireStats
+Count file system and loader activity of require, in total and per
+module being required. Work done while a dependency is required counts
+for the dependency. Everything outside of require, e.g. scripts and
+substitution files loaded from the startup script, counts as "(other)".
+*/
+
+static const char* const requireStatNames[REQUIRE_STAT_COUNT] = {
+    "stat hit", "stat miss", "dir open", "dir entry",
+    "fopen", "bytes read", "dlopen", "putenv"
+};
+
+typedef struct statsModule {
+    struct statsModule* next;
+    unsigned long count[REQUIRE_STAT_COUNT];
+    long heap;              /* heap grown while required, without dependencies */
+    char* library;          /* file actually loaded, may be in the local cache */
+    unsigned long rss, pss; /* kB of library mappings, see requireMemShow */
+    char name[1];
+} statsModule;
+
+static statsModule statsOther = { NULL, {0}, 0, NULL, 0, 0, "" };
+static statsModule* statsModules = &statsOther;
+static statsModule* statsCurrent = &statsOther;
+static unsigned long statsTotal[REQUIRE_STAT_COUNT];
+
+/* The shell counts script and file access without requireLock while
+   the deferred thread requires modules, thus switching statsCurrent.
+   Counts of the shell may then go to the deferred module, but are never lost.
+*/
+#if defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define STATS_ADD(counter, n) __atomic_fetch_add(&(counter), (n), __ATOMIC_RELAXED)
+#define STATS_GET(counter) __atomic_load_n(&(counter), __ATOMIC_RELAXED)
+#define STATS_CURRENT() __atomic_load_n(&statsCurrent, __ATOMIC_ACQUIRE)
+#define STATS_SET_CURRENT(m) __atomic_store_n(&statsCurrent, (m), __ATOMIC_RELEASE)
+#elif defined (__GNUC__) && (__GNUC__ == 4 && __GNUC_MINOR__ >= 1)
+#define STATS_ADD(counter, n) __sync_fetch_and_add(&(counter), (n))
+#define STATS_GET(counter) (*(const unsigned long volatile*)&(counter))
+#define STATS_CURRENT() (*(statsModule* volatile*)&statsCurrent)
+#define STATS_SET_CURRENT(m) do { __sync_synchronize(); statsCurrent = (m); } while (0)
+#else
+#define STATS_ADD(counter, n) ((counter) += (n))
+#define STATS_GET(counter) (counter)
+#define STATS_CURRENT() (*(statsModule* volatile*)&statsCurrent)
+#define STATS_SET_CURRENT(m) (*(statsModule* volatile*)&statsCurrent = (m))
+#endif
+
+void requireStatsAdd(int counter, size_t n)
+{
+    if (counter < 0 || counter >= REQUIRE_STAT_COUNT) return;
+    STATS_ADD(statsTotal[counter], n);
+    STATS_ADD(STATS_CURRENT()->count[counter], n);
+}
+
+#ifdef REQUIRE_PROBES
+#define REQUIRE_PROBE_SEMAPHORE_DEF(name) \
+    __extension__ unsigned short require_##name##_semaphore \
+    __attribute__ ((unused)) __attribute__ ((section (".probes")));
+REQUIRE_PROBE_NAMES(REQUIRE_PROBE_SEMAPHORE_DEF)
+
+/* per thread: other threads may run scripts or load templates meanwhile */
+static __thread const char* probeModule = "";
+static __thread const char* probeVersion = "";
+#else
+static const char* probeModule = "";
+static const char* probeVersion = "";
+#endif
+
+void requireProbeContext(const char** module, const char** version)
+{
+    *module = probeModule;
+    *version = probeVersion;
+}
+
+static statsModule* statsFind(const char* module)
+{
+    statsModule* m;
+
+    for (m = statsModules; m; m = m->next)
+        if (strcmp(m->name, module) == 0) break;
+    if (!m)
+    {
+        statsModule** last;
+        m = calloc(1, sizeof(statsModule) + strlen(module));
+        if (!m) return NULL;
+        strcpy(m->name, module);
+        for (last = &statsModules; *last; last = &(*last)->next);
+        *last = m;
+    }
+    return m;
+}
+
+static statsModule* statsEnter(const char* module)
+{
+    statsModule* previous = statsCurrent;
+    statsModule* m = statsFind(module);
+
+    if (m) STATS_SET_CURRENT(m);
+    return previous;
+}
+
+#if defined (__GLIBC__)
+#include <malloc.h>
+/* bytes allocated with malloc, including dbd and record memory */
+static long heapUsed(void)
+{
+#if __GLIBC_PREREQ(2,33)
+    struct mallinfo2 mi = mallinfo2();
+#else
+    struct mallinfo mi = mallinfo();
+#endif
+    return (long)mi.uordblks + (long)mi.hblkhd;
+}
+#else
+static long heapUsed(void)
+{
+    return 0;
+}
+#endif
+
+/* mallinfo walks all malloc arenas, thus attribute heap to modules only on request */
+static int heapStatsEnabled(void)
+{
+    static int enabled = -1;
+
+    if (enabled < 0)
+    {
+        const char* env = getenv("REQUIRE_HEAP_STATS");
+        enabled = env && env[0] && strcmp(env, "no") != 0;
+    }
+    return enabled;
+}
+
+static void statsPrint(const char* name, const unsigned long* count)
+{
+    int i;
+    printf("%-20s", name);
+    for (i = 0; i < REQUIRE_STAT_COUNT; i++)
+        printf(" %10lu", STATS_GET(count[i]));
+    printf("\n");
+}
+
+int requireStats(const char* module)
+{
+    statsModule* m;
+    int i;
+
+    printf("%-20s", "module");
+    for (i = 0; i < REQUIRE_STAT_COUNT; i++)
+        printf(" %10s", requireStatNames[i]);
+    printf("\n");
+    for (m = statsModules->next; m; m = m->next)
+        if (!module || !module[0] || strcmp(m->name, module) == 0)
+            statsPrint(m->name, m->count);
+    if (!module || !module[0])
+    {
+        statsPrint("(other)", statsOther.count);
+        statsPrint("total", statsTotal);
+    }
+    return 0;
+}
+
 /* loadlib (library)
 Find a loadable library by name and load it.
+On UNIX, the binding can be configured globally with REQUIRE_BINDING
+or per module with <module>_BINDING containing "lazy" and/or "local".
+Default is "now global".
 */
 
-static HMODULE loadlib(const char* libname)
+#if defined (UNIX)
+/* dlopen flags from the words lazy, now, local, global separated by spaces or commas */
+static int bindingFlags(const char* binding, const char* varname)
+{
+    int flags = RTLD_NOW|RTLD_GLOBAL;
+    size_t len;
+
+    while (*(binding += strspn(binding, " \t,")))
+    {
+        len = strcspn(binding, " \t,");
+        if (len == 4 && strncmp(binding, "lazy", len) == 0)
+            flags = (flags & ~RTLD_NOW) | RTLD_LAZY;
+        else if (len == 3 && strncmp(binding, "now", len) == 0)
+            flags = (flags & ~RTLD_LAZY) | RTLD_NOW;
+        else if (len == 5 && strncmp(binding, "local", len) == 0)
+            flags = (flags & ~RTLD_GLOBAL) | RTLD_LOCAL;
+        else if (len == 6 && strncmp(binding, "global", len) == 0)
+            flags = (flags & ~RTLD_LOCAL) | RTLD_GLOBAL;
+        else
+            fprintf(stderr, "Unknown binding \"%.*s\" in %s ignored, use lazy, now, local or global\n",
+                (int)len, binding, varname);
+        binding += len;
+    }
+    return flags;
+}
+#endif
+
+static HMODULE loadlib(const char* libname, const char* module)
 {
     HMODULE libhandle = NULL;
 
@@ -316,10 +551,49 @@ static HMODULE loadlib(const char* libname)
     }
 
 #if defined (UNIX)
-    if ((libhandle = dlopen(libname, RTLD_NOW|RTLD_GLOBAL)) == NULL)
     {
-        fprintf (stderr, "Loading %s library failed: %s\n",
-            libname, dlerror());
+        int flags = RTLD_NOW|RTLD_GLOBAL;
+        const char* binding = NULL;
+        char* varname = NULL;
+        struct timespec start, stop;
+
+        if (module && asprintf(&varname, "%s_BINDING", module) < 0)
+            varname = NULL;
+        if (varname)
+            binding = getenv(varname);
+        if (binding)
+            flags = bindingFlags(binding, varname);
+        else if ((binding = getenv("REQUIRE_BINDING")) != NULL)
+            flags = bindingFlags(binding, "REQUIRE_BINDING");
+        free(varname);
+
+        requireStatsAdd(REQUIRE_STAT_DLOPEN, 1);
+        REQUIRE_PROBE_CONTEXT(dlopen_start, libname);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        libhandle = dlopen(libname, flags);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        REQUIRE_PROBE_CONTEXT(dlopen_end, libname);
+        if (libhandle && module && statsCurrent != &statsOther && !statsCurrent->library)
+            statsCurrent->library = strdup(libname);
+        if (libhandle == NULL)
+        {
+            fprintf (stderr, "Loading %s library failed: %s\n",
+                libname, dlerror());
+        }
+        else if (requireDebug)
+        {
+            printf("require: dlopen %s (%s %s) took %.3f ms\n", libname,
+                flags & RTLD_LAZY ? "lazy" : "now", flags & RTLD_GLOBAL ? "global" : "local",
+                (stop.tv_sec - start.tv_sec) * 1000.0 + (stop.tv_nsec - start.tv_nsec) / 1000000.0);
+#if defined (__linux)
+            {
+                unsigned long nrel, nplt;
+                countRelocations(libhandle, &nrel, &nplt);
+                printf("require: %s has %lu relocations, %lu of them can be bound lazily\n",
+                    libname, nrel, nplt);
+            }
+#endif
+        }
     }
 #elif defined (_WIN32)
     {
@@ -328,6 +602,7 @@ static HMODULE loadlib(const char* libname)
         if ((p = strrchr(libpath, '/')) != NULL)
             *p = '\0';
         SetDllDirectory(libpath);
+        requireStatsAdd(REQUIRE_STAT_DLOPEN, 1);
         if ((libhandle = LoadLibrary(libname)) == NULL)
         {
             LPSTR lpMsgBuf;
@@ -384,13 +659,195 @@ typedef struct moduleitem
     char content[0];
 } moduleitem;
 
+/*
+The module list is read without locking by getLibVersion, getLibLocation,
+foreachLoadedLib and libversionShow, which device support and diagnostic
+threads may call at any time. It is only appended to by registerModule
+(with requireLock held) and entries are never modified or freed. A new
+entry is completely filled in before it is linked to the end of the list
+with a release barrier, so readers always see a consistent list, either
+with or without the new entry, and never have to wait.
+*/
 static moduleitem* loadedModules = NULL;
+
+#if defined (__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+#define MODULE_PUBLISH(link, m) __atomic_store_n(&(link), (m), __ATOMIC_RELEASE)
+#define MODULE_NEXT(link) __atomic_load_n(&(link), __ATOMIC_ACQUIRE)
+#elif defined (__GNUC__) && (__GNUC__ == 4 && __GNUC_MINOR__ >= 1)
+#define MODULE_PUBLISH(link, m) do { __sync_synchronize(); (link) = (m); } while (0)
+#define MODULE_NEXT(link) (*(moduleitem* volatile*)&(link))
+#elif defined (_WIN32)
+#define MODULE_PUBLISH(link, m) do { MemoryBarrier(); (link) = (m); } while (0)
+#define MODULE_NEXT(link) (*(moduleitem* volatile*)&(link))
+#elif defined (__GNUC__)
+/* old compilers (vxWorks): keep at least the compiler from reordering */
+#define MODULE_PUBLISH(link, m) do { __asm__ __volatile__ ("" ::: "memory"); (link) = (m); } while (0)
+#define MODULE_NEXT(link) (*(moduleitem* volatile*)&(link))
+#else
+#define MODULE_PUBLISH(link, m) (*(moduleitem* volatile*)&(link) = (m))
+#define MODULE_NEXT(link) (*(moduleitem* volatile*)&(link))
+#endif
+
 static unsigned long moduleCount = 0;
 static size_t moduleListBufferSize = 1;
 static size_t maxModuleNameLength = 0;
 static size_t maxVersionLength = 0;
 static size_t maxLocationLength = 0;
 
+/* serializes require() calls, which may run in the deferred thread too,
+   and all changes of the module list */
+#ifndef EPICS_3_13
+static epicsMutexId requireLock;
+static epicsThreadOnceId requireLockOnce = EPICS_THREAD_ONCE_INIT;
+static void requireLockCreate(void* arg)
+{
+    requireLock = epicsMutexMustCreate();
+}
+#define REQUIRE_LOCK_INIT() epicsThreadOnce(&requireLockOnce, requireLockCreate, NULL)
+#define REQUIRE_LOCK() epicsMutexMustLock(requireLock)
+#define REQUIRE_UNLOCK() epicsMutexUnlock(requireLock)
+#else
+#define REQUIRE_LOCK_INIT()
+#define REQUIRE_LOCK()
+#define REQUIRE_UNLOCK()
+#endif
+
+/* see requireDeferred */
+typedef struct deferredModule {
+    struct deferredModule* next;
+    const char* version;
+    char name[1];
+} deferredModule;
+
+static deferredModule* deferredModules = NULL;
+static unsigned long deferredCount = 0;   /* module list records reserve space for them */
+static size_t deferredBufferSize = 0;
+static size_t deferredNameLength = 0;
+static int deferredActive = 0;            /* require() runs in the deferred thread */
+static int deferredResolving = 0;         /* require() only checks and counts modules, see requireDeferred */
+
+#if defined (__linux)
+/* requireMemShow [module]
+Linux only: Attribute the RSS and PSS of library mappings in /proc/self/smaps
+to the modules in whose location (or local cache file) the library is,
+and show the heap that grew while each module was required.
+*/
+static int memUpdate(unsigned long* totalRss, unsigned long* totalPss)
+{
+    FILE* smaps;
+    char line[PATH_MAX+128];
+    statsModule* owner = NULL;
+    statsModule* s;
+    moduleitem* m;
+    size_t i, n = 0;
+    struct { char* location; size_t len; statsModule* stats; } *locations;
+    unsigned long kB, start, end;
+    char perms[5];
+
+    *totalRss = *totalPss = 0;
+    for (s = statsModules; s; s = s->next)
+        s->rss = s->pss = 0;
+    for (m = MODULE_NEXT(loadedModules); m; m = MODULE_NEXT(m->next)) n++;
+    locations = calloc(n ? n : 1, sizeof(*locations));
+    if (!locations) return -1;
+    /* compare real paths, because the kernel shows the real path of the mapped files */
+    for (m = MODULE_NEXT(loadedModules), n = 0; m; m = MODULE_NEXT(m->next))
+    {
+        size_t lm = strlen(m->content)+1;
+        size_t lv = strlen(m->content+lm)+1;
+        char* location = m->content+lm+lv;
+
+        if (!location[0]) continue;
+        if ((locations[n].location = realpath(location, NULL)) == NULL) continue;
+        locations[n].len = strlen(locations[n].location);
+        locations[n].stats = statsFind(m->content);
+        if (locations[n].stats) n++;
+        else free(locations[n].location);
+    }
+    smaps = fopen("/proc/self/smaps", "r");
+    if (!smaps)
+    {
+        fprintf(stderr, "Cannot open /proc/self/smaps: %s\n", strerror(errno));
+        for (i = 0; i < n; i++) free(locations[i].location);
+        free(locations);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), smaps))
+    {
+        char* path;
+
+        if (sscanf(line, "Rss: %lu kB", &kB) == 1)
+        {
+            *totalRss += kB;
+            if (owner) owner->rss += kB;
+            continue;
+        }
+        if (sscanf(line, "Pss: %lu kB", &kB) == 1)
+        {
+            *totalPss += kB;
+            if (owner) owner->pss += kB;
+            continue;
+        }
+        /* mapping header: address perms offset dev inode [path] */
+        if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) != 3) continue;
+        owner = NULL;
+        if ((path = strchr(line, '/')) == NULL) continue;
+        path[strcspn(path, "\n")] = 0;
+        for (i = 0; i < n && !owner; i++)
+        {
+            if (strncmp(path, locations[i].location, locations[i].len) == 0 &&
+                (path[locations[i].len] == '/' || locations[i].location[locations[i].len-1] == '/'))
+                owner = locations[i].stats;
+        }
+        for (s = statsModules->next; s && !owner; s = s->next)
+            if (s->library && strcmp(path, s->library) == 0) owner = s;
+    }
+    fclose(smaps);
+    for (i = 0; i < n; i++) free(locations[i].location);
+    free(locations);
+    return 0;
+}
+
+int requireMemShow(const char* module)
+{
+    moduleitem* m;
+    unsigned long totalRss, totalPss;
+
+    REQUIRE_LOCK_INIT();
+    REQUIRE_LOCK();
+    if (memUpdate(&totalRss, &totalPss) != 0)
+    {
+        REQUIRE_UNLOCK();
+        return -1;
+    }
+    printf("%-20s %-20s %10s %10s %10s\n", "module", "version", "lib RSS kB", "lib PSS kB", "heap kB");
+    for (m = MODULE_NEXT(loadedModules); m; m = MODULE_NEXT(m->next))
+    {
+        statsModule* s;
+        size_t lm = strlen(m->content)+1;
+
+        if (module && module[0] && strcmp(m->content, module) != 0) continue;
+        if ((s = statsFind(m->content)) == NULL) continue;
+        if (heapStatsEnabled())
+            printf("%-20s %-20s %10lu %10lu %10ld\n", m->content, m->content+lm,
+                s->rss, s->pss, s->heap / 1024);
+        else
+            printf("%-20s %-20s %10lu %10lu %10s\n", m->content, m->content+lm,
+                s->rss, s->pss, "-");
+    }
+    if (!module || !module[0])
+        printf("%-20s %-20s %10lu %10lu %10ld\n", "process", "", totalRss, totalPss, heapUsed() / 1024);
+    REQUIRE_UNLOCK();
+    return 0;
+}
+#else
+int requireMemShow(const char* module)
+{
+    fprintf(stderr, "requireMemShow is only available on Linux\n");
+    return -1;
+}
+#endif
+
 int putenvprintf(const char* format, ...)
 {
     va_list ap;
@@ -409,6 +866,7 @@ int putenvprintf(const char* format, ...)
 
     if (requireDebug)
         printf("require: putenv(\"%s\")\n", var);
+    requireStatsAdd(REQUIRE_STAT_PUTENV, 1);
 
     val = strchr(var, '=');
     if (!val)
@@ -437,127 +895,700 @@ int putenvprintf(const char* format, ...)
     return status;
 }
 
-void pathAdd(const char* varname, const char* dirname)
+/* path lists
+Pre-split copies of path environment variables like SCRIPT_PATH or
+EPICS_DB_INCLUDE_PATH. Each directory is stored once and found by hash,
+thus pathAdd() does not need to search and edit the string.
+The environment string is parsed again only if someone else changed it
+and written back only if pathAdd() changed the list.
+*/
+
+typedef struct pathDir
 {
-    char* old_path;
+    size_t len;
+    unsigned int hash;
+    char name[0];
+} pathDir;
 
-    if (!varname || !dirname) {
-        fprintf(stderr, "usage: pathAdd \"ENVIRONMENT_VARIABLE\",\"directory\"\n");
-        fprintf(stderr, "       Adds or moves the directory to the front of the ENVIRONMENT_VARIABLE\n");
-        fprintf(stderr, "       but after a leading \".\".\n");
-        return;
+typedef struct pathList
+{
+    struct pathList* next;
+    char* value;           /* environment string as last parsed or written */
+    pathDir** dirs;        /* directories in search order */
+    size_t count;
+    size_t size;
+    pathDir** set;         /* hash set of dirs, open addressing */
+    size_t setsize;        /* power of 2 and more than 2*count */
+    char varname[0];
+} pathList;
+
+static pathList* pathLists = NULL;
+
+static unsigned int pathHash(const char* name, size_t len)
+{
+    unsigned int hash = 2166136261u; /* FNV-1a */
+    while (len--)
+    {
+        hash ^= (unsigned char)*name++;
+        hash *= 16777619u;
     }
+    return hash;
+}
 
-    /* add directory to front */
-    old_path = getenv(varname);
-    if (old_path == NULL)
-        putenvprintf("%s=." OSI_PATH_LIST_SEPARATOR "%s", varname, dirname);
-    else
+static pathDir* pathFind(pathList* list, const char* name, size_t len, unsigned int hash)
+{
+    size_t i;
+    pathDir* d;
+
+    if (!list->setsize) return NULL;
+    for (i = hash & (list->setsize-1); (d = list->set[i]) != NULL; i = (i+1) & (list->setsize-1))
     {
-        size_t len = strlen(dirname);
-        char* p;
+        if (d->hash == hash && d->len == len && memcmp(d->name, name, len) == 0)
+            return d;
+    }
+    return NULL;
+}
+
+static int pathInsert(pathList* list, size_t pos, const char* name, size_t len)
+{
+    unsigned int hash = pathHash(name, len);
+    pathDir* d;
+    size_t i;
 
-        /* skip over "." at the beginning */
-        if (old_path[0] == '.' && old_path[1] == OSI_PATH_LIST_SEPARATOR[0])
-            old_path += 2;
+    if (pathFind(list, name, len, hash)) return 0; /* ignore duplicates */
 
-        /* If directory is already in path, move it to front */
-        p = old_path;
-        while ((p = strstr(p, dirname)) != NULL)
+    if (list->count == list->size)
+    {
+        size_t size = list->size ? list->size * 2 : 16;
+        pathDir** dirs = realloc(list->dirs, size * sizeof(pathDir*));
+        if (!dirs) return -1;
+        list->dirs = dirs;
+        list->size = size;
+    }
+    if (2 * (list->count+1) >= list->setsize)
+    {
+        size_t setsize = list->setsize ? list->setsize * 2 : 32;
+        pathDir** set = calloc(setsize, sizeof(pathDir*));
+        if (!set) return -1;
+        for (i = 0; i < list->count; i++)
         {
-            if ((p == old_path || *(p-1) == OSI_PATH_LIST_SEPARATOR[0]) &&
-                (p[len] == 0 || p[len] == OSI_PATH_LIST_SEPARATOR[0]))
-            {
-                if (p == old_path) break; /* already at front, nothing to do */
-                memmove(old_path+len+1, old_path, p-old_path-1);
-                strcpy(old_path, dirname);
-                old_path[len] = OSI_PATH_LIST_SEPARATOR[0];
-                if (requireDebug)
-                    printf("require: modified %s=%s\n", varname, old_path);
-                break;
-            }
-            p += len;
+            size_t j = list->dirs[i]->hash & (setsize-1);
+            while (set[j]) j = (j+1) & (setsize-1);
+            set[j] = list->dirs[i];
         }
-        if (p == NULL)
-            /* add new directory to the front (after "." )*/
-            putenvprintf("%s=." OSI_PATH_LIST_SEPARATOR "%s" OSI_PATH_LIST_SEPARATOR "%s",
-                 varname, dirname, old_path);
+        free(list->set);
+        list->set = set;
+        list->setsize = setsize;
     }
+    d = malloc(sizeof(pathDir) + len + 1);
+    if (!d) return -1;
+    d->len = len;
+    d->hash = hash;
+    memcpy(d->name, name, len);
+    d->name[len] = 0;
+    for (i = hash & (list->setsize-1); list->set[i]; i = (i+1) & (list->setsize-1));
+    list->set[i] = d;
+    if (pos > list->count) pos = list->count;
+    memmove(list->dirs+pos+1, list->dirs+pos, (list->count-pos) * sizeof(pathDir*));
+    list->dirs[pos] = d;
+    list->count++;
+    return 0;
 }
 
-static int setupDbPath(const char* module, const char* dbdir)
+static void pathClear(pathList* list)
 {
-    char* absdir = realpath(dbdir, NULL); /* so we can change directory later safely */
-    if (absdir == NULL)
+    size_t i;
+
+    for (i = 0; i < list->count; i++)
+        free(list->dirs[i]);
+    list->count = 0;
+    if (list->set) memset(list->set, 0, list->setsize * sizeof(pathDir*));
+    free(list->value);
+    list->value = NULL;
+}
+
+/* get path list of an environment variable, re-parse if environment has changed */
+static pathList* pathGet(const char* varname)
+{
+    pathList* list;
+    const char* value;
+    const char* dirname;
+    const char* end;
+    size_t len;
+
+    for (list = pathLists; list; list = list->next)
+        if (strcmp(list->varname, varname) == 0) break;
+    if (!list)
     {
-        if (requireDebug)
-            printf("require: cannot resolve %s\n", dbdir);
-        return -1;
+        len = strlen(varname);
+        list = calloc(1, sizeof(pathList) + len + 1);
+        if (!list)
+        {
+            fprintf(stderr, "require: out of memory\n");
+            return NULL;
+        }
+        memcpy(list->varname, varname, len+1);
+        list->next = pathLists;
+        pathLists = list;
     }
 
+    value = getenv(varname);
+    if (value == list->value || (value && list->value && strcmp(value, list->value) == 0))
+        return list;
+
     if (requireDebug)
-        printf("require: found template directory %s\n", absdir);
+        printf("require: parsing %s=%s\n", varname, value);
+    pathClear(list);
+    if (!value) return list;
+    list->value = strdup(value);
+    for (dirname = value; dirname != NULL; dirname = end)
+    {
+        end = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0]);
+        if (end && end[1] == '/' && end[2] == '/')   /* "http://..." and friends */
+            end = strchr(end+2, OSI_PATH_LIST_SEPARATOR[0]);
+        if (end) len = end++ - dirname;
+        else len = strlen(dirname);
+        if (len == 0) continue; /* ignore empty path elements */
+        if (pathInsert(list, list->count, dirname, len) != 0)
+        {
+            fprintf(stderr, "require: out of memory\n");
+            break;
+        }
+    }
+    return list;
+}
 
-    /* set up db search path environment variables
-      <module>_TEMPLATES      template path of <module>
-      <module>_DB             template path of <module>
-      TEMPLATES               template path of the current module (overwritten)
-      EPICS_DB_INCLUDE_PATH   template path of all loaded modules (last in front after ".")
-    */
+/* write path list back to environment */
+static void pathWrite(pathList* list)
+{
+    size_t i, len = 0;
+    char* value;
+    char* p;
 
-    putenvprintf("%s_DB=%s/", module, absdir);
-    putenvprintf("%s_TEMPLATES=%s/", module, absdir);
-    putenvprintf("TEMPLATES=%s/", absdir);
-    pathAdd("EPICS_DB_INCLUDE_PATH", absdir);
-    free(absdir);
-    return 0;
+    for (i = 0; i < list->count; i++)
+        len += list->dirs[i]->len + 1;
+    p = value = malloc(len + 1);
+    if (!value)
+    {
+        fprintf(stderr, "require: out of memory\n");
+        return;
+    }
+    for (i = 0; i < list->count; i++)
+    {
+        if (i) *p++ = OSI_PATH_LIST_SEPARATOR[0];
+        memcpy(p, list->dirs[i]->name, list->dirs[i]->len);
+        p += list->dirs[i]->len;
+    }
+    *p = 0;
+    putenvprintf("%s=%s", list->varname, value);
+    free(list->value);
+    list->value = value;
 }
 
-static int getRecordHandle(const char* namepart, short type, size_t minsize, DBADDR* paddr)
+void pathAdd(const char* varname, const char* dirname)
 {
-    char recordname[PVNAME_STRINGSZ];
-    long dummy, offset;
+    pathList* list;
+    pathDir* d;
+    size_t len, i, front;
 
-    sprintf(recordname, "%.*s%s", (int)(PVNAME_STRINGSZ-strlen(namepart)-1), getenv("IOC"), namepart);
-    if (dbNameToAddr(recordname, paddr) != 0)
-    {
-        if (requireDebug)
-            fprintf(stderr, "require: record %s not found\n",
-                recordname);
-        return -1;
+    if (!varname || !dirname) {
+        fprintf(stderr, "usage: pathAdd \"ENVIRONMENT_VARIABLE\",\"directory\"\n");
+        fprintf(stderr, "       Adds or moves the directory to the front of the ENVIRONMENT_VARIABLE\n");
+        fprintf(stderr, "       but after a leading \".\".\n");
+        return;
     }
-    if (paddr->field_type != type)
+
+    list = pathGet(varname);
+    if (!list) return;
+
+    /* skip over "." at the beginning */
+    front = (list->count && list->dirs[0]->len == 1 && list->dirs[0]->name[0] == '.');
+
+    len = strlen(dirname);
+    d = pathFind(list, dirname, len, pathHash(dirname, len));
+    if (d)
     {
-        fprintf(stderr, "require: record %s has wrong type %s instead of %s\n",
-            recordname, pamapdbfType[paddr->field_type].strvalue, pamapdbfType[type].strvalue);
-        return -1;
+        /* If directory is already in path, move it to front */
+        for (i = 0; list->dirs[i] != d; i++);
+        if (i <= front) return; /* already at front, nothing to do */
+        memmove(list->dirs+front+1, list->dirs+front, (i-front) * sizeof(pathDir*));
+        list->dirs[front] = d;
     }
-    if ((size_t)paddr->no_elements < minsize)
+    else
     {
-        fprintf(stderr, "require: record %s has not enough elements: %lu instead of %lu\n",
-            recordname, paddr->no_elements, (unsigned long)minsize);
-        return -1;
+        /* add new directory to the front (after "." )*/
+        if (pathInsert(list, front, dirname, len) != 0 ||
+            (!front && pathInsert(list, 0, ".", 1) != 0))
+        {
+            fprintf(stderr, "require: out of memory\n");
+            return;
+        }
     }
-    if (paddr->pfield == NULL)
+    pathWrite(list);
+}
+
+size_t foreachPathDir(const char* varname, size_t (*func)(const char* dirname, size_t len, void* arg), void* arg)
+{
+    pathList* list;
+    size_t i;
+    size_t result;
+
+    if (!varname || (list = pathGet(varname)) == NULL) return 0;
+    for (i = 0; i < list->count; i++)
     {
-        fprintf(stderr, "require: record %s has not yet allocated memory\n",
-            recordname);
-        return -1;
+        result = func(list->dirs[i]->name, list->dirs[i]->len, arg);
+        if (result) return result;
     }
-    /* update array information */
-    dbGetRset(paddr)->get_array_info(paddr, &dummy, &offset);
     return 0;
 }
 
-/*
-We can fill the records only after they have been initialized, at initHookAfterFinishDevSup.
-But use double indirection here because in 3.13 we must
-wait until initHooks is loaded before we can register the hook.
+/* local cache
+UNIX only, opt-in: If REQUIRE_LOCAL_CACHE is set to a directory, the files
+of a module are copied from the (NFS mounted) pool to this directory and
+loaded from there. Each pool directory is mirrored to a subdirectory named
+after the hash of its path. A copy is up to date if size and mtime (with
+sub-second resolution) match the pool file. Pool directories with
+subdirectories are not mirrored. Least recently used subdirectories are
+removed if the cache grows beyond REQUIRE_LOCAL_CACHE_SIZE MB (default 1024).
+The cache directory must belong to the user and have mode 0700 because
+other users could replace the files loaded from it.
+Each IOC holds a shared flock on the mirror directories it uses, as long as
+it runs, and only directories nobody holds are removed.
+The environment variables <module>_DIR and the version records still use
+the pool location.
 */
 
-static void fillModuleListRecord(initHookState state)
+#if defined (UNIX)
+#include <fcntl.h>
+#include <time.h>
+#include <sys/file.h>
+
+#if defined (__APPLE__)
+#define ST_MTIM(s) (s).st_mtimespec
+#else
+#define ST_MTIM(s) (s).st_mtim
+#endif
+
+#define LOCAL_CACHE_DEFAULT_SIZE 1024 /* MB */
+
+static int localCacheChanged = 0;
+
+static const char* localCacheDir(void)
 {
-    if (state == initHookAfterFinishDevSup) /* MODULES record exists and has allocated memory */
+    static char* checked = NULL;
+    const char* cachedir = getenv("REQUIRE_LOCAL_CACHE");
+    struct stat filestat;
+
+    if (!cachedir || !cachedir[0]) return NULL;
+    if (checked && strcmp(checked, cachedir) == 0) return checked;
+    if (mkdir(cachedir, 0700) != 0 && errno != EEXIST)
+    {
+        perror(cachedir);
+        return NULL;
+    }
+    /* others must not be able to replace what we load, not even via a symlink */
+    if (lstat(cachedir, &filestat) != 0 || !S_ISDIR(filestat.st_mode) ||
+        filestat.st_uid != geteuid() || (filestat.st_mode & 077) != 0)
+    {
+        fprintf(stderr, "require: local cache %s must be a directory of user %d with mode 0700\n",
+            cachedir, (int)geteuid());
+        return NULL;
+    }
+    free(checked);
+    checked = strdup(cachedir);
+    return checked;
+}
+
+/* mirror directories this IOC holds a shared flock on */
+typedef struct localCacheUsed
+{
+    struct localCacheUsed* next;
+    int fd;
+    char name[1];
+} localCacheUsed;
+
+static localCacheUsed* localCacheUsedDirs = NULL;
+
+/* keep a mirror directory from being evicted while this IOC runs */
+static int localCacheUse(const char* mirrordir)
+{
+    localCacheUsed* u;
+    struct stat fdstat, dirstat;
+    int fd;
+
+    for (u = localCacheUsedDirs; u; u = u->next)
+        if (strcmp(u->name, mirrordir) == 0)
+        {
+            /* mark it used for least recently used eviction */
+            futimens(u->fd, NULL);
+            return 0;
+        }
+    while (1)
+    {
+        if (mkdir(mirrordir, 0700) != 0 && errno != EEXIST)
+        {
+            perror(mirrordir);
+            return -1;
+        }
+        if ((fd = open(mirrordir, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC)) < 0)
+        {
+            if (errno == ENOENT) continue; /* evicted just now */
+            perror(mirrordir);
+            return -1;
+        }
+        if (flock(fd, LOCK_SH) != 0)
+        {
+            perror(mirrordir);
+            close(fd);
+            return -1;
+        }
+        /* an eviction may have removed it while we were waiting for the lock */
+        if (fstat(fd, &fdstat) == 0 && stat(mirrordir, &dirstat) == 0 &&
+            fdstat.st_ino == dirstat.st_ino && fdstat.st_dev == dirstat.st_dev)
+            break;
+        close(fd);
+    }
+    futimens(fd, NULL);
+    u = malloc(sizeof(localCacheUsed) + strlen(mirrordir));
+    if (!u)
+    {
+        close(fd);
+        return -1;
+    }
+    u->fd = fd;
+    strcpy(u->name, mirrordir);
+    u->next = localCacheUsedDirs;
+    localCacheUsedDirs = u;
+    return 0;
+}
+
+/* get the mirror directory for a pool directory, create it and mark it used */
+static int localCacheMirrorPath(const char* pooldir, size_t len, char* buffer, size_t size)
+{
+    const char* cachedir = localCacheDir();
+    unsigned long long hash = 14695981039346656037ull; /* FNV-1a 64 bit */
+    size_t i;
+
+    if (!cachedir) return -1;
+    while (len > 1 && pooldir[len-1] == '/') len--;
+    for (i = 0; i < len; i++)
+    {
+        hash ^= (unsigned char)pooldir[i];
+        hash *= 1099511628211ull;
+    }
+    if ((size_t)snprintf(buffer, size, "%s/%016llx", cachedir, hash) >= size) return -1;
+    return localCacheUse(buffer);
+}
+
+/* copy file if local copy is missing or outdated */
+static int localCacheCopy(const char* poolfile, const char* localfile)
+{
+    struct stat poolstat, localstat;
+    struct timespec times[2];
+    char* tmpfile;
+    char buffer[65536];
+    ssize_t n = 0;
+    int in, out;
+
+    if (stat(poolfile, &poolstat) != 0 || !S_ISREG(poolstat.st_mode)) return -1;
+    if (stat(localfile, &localstat) == 0 &&
+        localstat.st_size == poolstat.st_size &&
+        ST_MTIM(localstat).tv_sec == ST_MTIM(poolstat).tv_sec &&
+        ST_MTIM(localstat).tv_nsec == ST_MTIM(poolstat).tv_nsec)
+        return 0; /* up to date */
+
+    if (requireDebug)
+        printf("require: copying %s to %s\n", poolfile, localfile);
+    if (asprintf(&tmpfile, "%s.%d", localfile, (int)getpid()) < 0) return -1;
+    in = open(poolfile, O_RDONLY);
+    out = open(tmpfile, O_WRONLY|O_CREAT|O_TRUNC|O_NOFOLLOW, poolstat.st_mode & 0700);
+    if (in >= 0 && out >= 0)
+    {
+        while ((n = read(in, buffer, sizeof(buffer))) > 0)
+            if (write(out, buffer, n) != n) { n = -1; break; }
+        times[0] = ST_MTIM(poolstat);
+        times[1] = ST_MTIM(poolstat);
+        if (n >= 0 && futimens(out, times) != 0) n = -1;
+    }
+    if (in >= 0) close(in);
+    if (out >= 0 && close(out) != 0) n = -1;
+    if (in < 0 || out < 0 || n < 0)
+    {
+        perror(tmpfile);
+        unlink(tmpfile);
+        free(tmpfile);
+        return -1;
+    }
+    /* rename is atomic, thus concurrent IOCs see either the old or the new file */
+    if (rename(tmpfile, localfile) != 0)
+    {
+        perror(localfile);
+        unlink(tmpfile);
+        free(tmpfile);
+        return -1;
+    }
+    free(tmpfile);
+    localCacheChanged = 1;
+    return 0;
+}
+
+/* get local copy of a pool file, returns the pool file if not possible */
+static const char* localCacheFile(const char* poolfile, char* buffer, size_t size)
+{
+    const char* basename = strrchr(poolfile, '/');
+    size_t len;
+
+    if (!basename) return poolfile;
+    if (localCacheMirrorPath(poolfile, basename - poolfile, buffer, size) != 0) return poolfile;
+    len = strlen(buffer);
+    if ((size_t)snprintf(buffer+len, size-len, "%s", basename) >= size-len) return poolfile;
+    if (localCacheCopy(poolfile, buffer) != 0) return poolfile;
+    return buffer;
+}
+
+/* get local copy of all files in a pool directory, returns the pool directory if not possible */
+static const char* localCacheDirectory(const char* pooldir, char* buffer, size_t size)
+{
+    DIR* dir;
+    struct dirent* direntry;
+    struct stat filestat;
+    char* poolfile;
+    size_t len;
+    int status = 0;
+
+    if ((dir = opendir(pooldir)) == NULL) return pooldir;
+    /* subdirectories are not mirrored, files may refer to them */
+    while ((direntry = readdir(dir)) != NULL)
+    {
+        if (direntry->d_name[0] == '.') continue;
+        if (asprintf(&poolfile, "%s/%s", pooldir, direntry->d_name) < 0)
+        {
+            closedir(dir);
+            return pooldir;
+        }
+        if (stat(poolfile, &filestat) != 0 || !S_ISREG(filestat.st_mode))
+        {
+            if (requireDebug)
+                printf("require: not mirroring %s because of %s\n", pooldir, direntry->d_name);
+            free(poolfile);
+            closedir(dir);
+            return pooldir;
+        }
+        free(poolfile);
+    }
+    if (localCacheMirrorPath(pooldir, strlen(pooldir), buffer, size) != 0)
+    {
+        closedir(dir);
+        return pooldir;
+    }
+    len = strlen(buffer);
+    rewinddir(dir);
+    while ((direntry = readdir(dir)) != NULL)
+    {
+        if (direntry->d_name[0] == '.') continue;
+        if ((size_t)snprintf(buffer+len, size-len, "/%s", direntry->d_name) >= size-len ||
+            asprintf(&poolfile, "%s/%s", pooldir, direntry->d_name) < 0)
+        {
+            status = -1;
+            break;
+        }
+        status = localCacheCopy(poolfile, buffer);
+        free(poolfile);
+        if (status != 0) break;
+    }
+    closedir(dir);
+    buffer[len] = 0;
+    return status == 0 ? buffer : pooldir;
+}
+
+typedef struct localCacheItem
+{
+    time_t used;
+    unsigned long long size;
+    char name[32];
+} localCacheItem;
+
+static int localCacheCompare(const void* a, const void* b)
+{
+    time_t ta = ((const localCacheItem*)a)->used;
+    time_t tb = ((const localCacheItem*)b)->used;
+    return ta < tb ? -1 : ta > tb;
+}
+
+/* remove least recently used mirror directories if cache is too large */
+static void localCacheEvict(void)
+{
+    const char* cachedir;
+    const char* sizestr;
+    unsigned long long limit, total = 0;
+    localCacheItem* items = NULL;
+    size_t count = 0, i;
+    DIR* dir;
+    DIR* subdir;
+    struct dirent* direntry;
+    struct dirent* subentry;
+    struct stat filestat;
+    char path[PATH_MAX];
+
+    if (!localCacheChanged) return;
+    localCacheChanged = 0;
+    if ((cachedir = localCacheDir()) == NULL) return;
+    sizestr = getenv("REQUIRE_LOCAL_CACHE_SIZE");
+    limit = (sizestr ? strtoull(sizestr, NULL, 10) : LOCAL_CACHE_DEFAULT_SIZE) << 20;
+
+    if ((dir = opendir(cachedir)) == NULL) return;
+    while ((direntry = readdir(dir)) != NULL)
+    {
+        localCacheItem* item;
+
+        if (direntry->d_name[0] == '.' || strlen(direntry->d_name) >= sizeof(items->name)) continue;
+        snprintf(path, sizeof(path), "%s/%s", cachedir, direntry->d_name);
+        if (stat(path, &filestat) != 0 || !S_ISDIR(filestat.st_mode)) continue;
+        if (count % 64 == 0)
+        {
+            localCacheItem* p = realloc(items, (count + 64) * sizeof(localCacheItem));
+            if (!p) break;
+            items = p;
+        }
+        item = &items[count++];
+        item->used = filestat.st_mtime;
+        item->size = 0;
+        strcpy(item->name, direntry->d_name);
+        if ((subdir = opendir(path)) == NULL) continue;
+        while ((subentry = readdir(subdir)) != NULL)
+        {
+            snprintf(path, sizeof(path), "%s/%s/%s", cachedir, item->name, subentry->d_name);
+            if (stat(path, &filestat) == 0 && S_ISREG(filestat.st_mode))
+                item->size += filestat.st_size;
+        }
+        closedir(subdir);
+        total += item->size;
+    }
+    closedir(dir);
+
+    if (requireDebug)
+        printf("require: local cache %s uses %llu of %llu MB\n", cachedir, total >> 20, limit >> 20);
+    qsort(items, count, sizeof(localCacheItem), localCacheCompare);
+    for (i = 0; i < count && total > limit; i++)
+    {
+        int fd;
+
+        /* skip directories any IOC (including this one) still uses */
+        snprintf(path, sizeof(path), "%s/%s", cachedir, items[i].name);
+        if ((fd = open(path, O_RDONLY|O_DIRECTORY|O_NOFOLLOW|O_CLOEXEC)) < 0) continue;
+        if (flock(fd, LOCK_EX|LOCK_NB) != 0)
+        {
+            close(fd);
+            continue;
+        }
+        if (requireDebug)
+            printf("require: removing %s/%s from local cache\n", cachedir, items[i].name);
+        if ((subdir = opendir(path)) != NULL)
+        {
+            while ((subentry = readdir(subdir)) != NULL)
+            {
+                if (subentry->d_name[0] == '.') continue;
+                snprintf(path, sizeof(path), "%s/%s/%s", cachedir, items[i].name, subentry->d_name);
+                unlink(path);
+            }
+            closedir(subdir);
+        }
+        snprintf(path, sizeof(path), "%s/%s", cachedir, items[i].name);
+        rmdir(path);
+        close(fd);
+        total -= items[i].size;
+    }
+    free(items);
+}
+
+#else
+#define localCacheFile(poolfile, buffer, size) (poolfile)
+#define localCacheDirectory(pooldir, buffer, size) (pooldir)
+#define localCacheEvict()
+#endif
+
+static int setupDbPath(const char* module, const char* dbdir)
+{
+    char localdir[PATH_MAX];
+    const char* templatedir;
+    char* absdir = realpath(dbdir, NULL); /* so we can change directory later safely */
+    if (absdir == NULL)
+    {
+        if (requireDebug)
+            printf("require: cannot resolve %s\n", dbdir);
+        return -1;
+    }
+    templatedir = localCacheDirectory(absdir, localdir, sizeof(localdir));
+    if (templatedir != absdir)
+    {
+        free(absdir);
+        absdir = strdup(templatedir);
+        if (absdir == NULL) return -1;
+    }
+
+    if (requireDebug)
+        printf("require: found template directory %s\n", absdir);
+
+    /* set up db search path environment variables
+      <module>_TEMPLATES      template path of <module>
+      <module>_DB             template path of <module>
+      TEMPLATES               template path of the current module (overwritten)
+      EPICS_DB_INCLUDE_PATH   template path of all loaded modules (last in front after ".")
+    */
+
+    putenvprintf("%s_DB=%s/", module, absdir);
+    putenvprintf("%s_TEMPLATES=%s/", module, absdir);
+    putenvprintf("TEMPLATES=%s/", absdir);
+    pathAdd("EPICS_DB_INCLUDE_PATH", absdir);
+    free(absdir);
+    return 0;
+}
+
+static int getRecordHandle(const char* namepart, short type, size_t minsize, DBADDR* paddr)
+{
+    char recordname[PVNAME_STRINGSZ];
+    long dummy, offset;
+
+    sprintf(recordname, "%.*s%s", (int)(PVNAME_STRINGSZ-strlen(namepart)-1), getenv("IOC"), namepart);
+    if (dbNameToAddr(recordname, paddr) != 0)
+    {
+        if (requireDebug)
+            fprintf(stderr, "require: record %s not found\n",
+                recordname);
+        return -1;
+    }
+    if (paddr->field_type != type)
+    {
+        fprintf(stderr, "require: record %s has wrong type %s instead of %s\n",
+            recordname, pamapdbfType[paddr->field_type].strvalue, pamapdbfType[type].strvalue);
+        return -1;
+    }
+    if ((size_t)paddr->no_elements < minsize)
+    {
+        fprintf(stderr, "require: record %s has not enough elements: %lu instead of %lu\n",
+            recordname, paddr->no_elements, (unsigned long)minsize);
+        return -1;
+    }
+    if (paddr->pfield == NULL)
+    {
+        fprintf(stderr, "require: record %s has not yet allocated memory\n",
+            recordname);
+        return -1;
+    }
+    /* update array information */
+    dbGetRset(paddr)->get_array_info(paddr, &dummy, &offset);
+    return 0;
+}
+
+/*
+We can fill the records only after they have been initialized, at initHookAfterFinishDevSup.
+But use double indirection here because in 3.13 we must
+wait until initHooks is loaded before we can register the hook.
+*/
+
+static void fillModuleListRecord(initHookState state)
+{
+    if (state == initHookAfterFinishDevSup) /* MODULES record exists and has allocated memory */
     {
         DBADDR modules, versions, modver, origin;
         int have_modules, have_versions, have_modver;
@@ -565,17 +1596,27 @@ static void fillModuleListRecord(initHookState state)
         int i = 0;
         long c = 0;
         char originName[PVNAME_STRINGSZ];
+#if defined (__linux)
+        DBADDR mem;
+        char memName[PVNAME_STRINGSZ];
+        unsigned long totalRss, totalPss;
+        int have_mem;
+#endif
 
+        REQUIRE_LOCK();
         if (requireDebug)
             printf("require: fillModuleListRecord\n");
+#if defined (__linux)
+        have_mem = (memUpdate(&totalRss, &totalPss) == 0);
+#endif
 
         have_modules  = (getRecordHandle(":MODULES",  DBF_STRING, moduleCount, &modules) == 0);
         have_versions = (getRecordHandle(":VERSIONS", DBF_STRING, moduleCount, &versions) == 0);
 
-        moduleListBufferSize += moduleCount * maxModuleNameLength;
-        have_modver   = (getRecordHandle(":MOD_VER",  DBF_CHAR, moduleListBufferSize, &modver) == 0);
+        have_modver   = (getRecordHandle(":MOD_VER",  DBF_CHAR,
+            moduleListBufferSize + moduleCount * maxModuleNameLength, &modver) == 0);
 
-        for (m = loadedModules, i = 0; m; m=m->next, i++)
+        for (m = MODULE_NEXT(loadedModules), i = 0; m; m = MODULE_NEXT(m->next), i++)
         {
             size_t lm = strlen(m->content)+1;
             size_t lv = strlen(m->content+lm)+1;
@@ -615,64 +1656,711 @@ static void fillModuleListRecord(initHookState state)
                 strncpy(origin.pfield, m->content+lm+lv+ll, lo);
                 dbGetRset(&origin)->put_array_info(&origin, (int)lo);
             }
+#if defined (__linux)
+            sprintf(memName, ":%.*s_MEM", (int)(PVNAME_STRINGSZ-6), m->content);
+            if (have_mem && getRecordHandle(memName, DBF_DOUBLE, 3, &mem) == 0)
+            {
+                statsModule* s = statsFind(m->content);
+                if (s)
+                {
+                    ((double*)mem.pfield)[0] = s->rss;
+                    ((double*)mem.pfield)[1] = s->pss;
+                    ((double*)mem.pfield)[2] = s->heap / 1024;
+                    dbGetRset(&mem)->put_array_info(&mem, 3);
+                }
+            }
+#endif
         }
         if (have_modules) dbGetRset(&modules)->put_array_info(&modules, i);
         if (have_versions) dbGetRset(&versions)->put_array_info(&versions, i);
         if (have_modver) dbGetRset(&modver)->put_array_info(&modver, c+1);
+        REQUIRE_UNLOCK();
     }
 }
 
+/* Names built by require_priv in fileBase.path start with fileBase.len
+   characters naming the open driver path directory fileBase.fd, see getDriverPath.
+   Files below it are looked up relative to that directory. */
+static struct {
+    const char* path;
+    int len;
+    int fd;
+} fileBase = { NULL, 0, -1 };
+
 static off_t fileSize(const char* filename)
 {
     struct stat filestat;
-    if (stat(
+    int status;
+
+#if defined (__linux)
+    if (filename == fileBase.path && fileBase.fd >= 0)
+        status = fstatat(fileBase.fd, filename[fileBase.len] ? filename + fileBase.len : ".", &filestat, 0);
+    else
+#endif
+    status = stat(
 #ifdef vxWorks
         (char*) /* vxWorks has buggy stat prototype */
 #endif
-        filename, &filestat) != 0)
+        filename, &filestat);
+    if (status != 0)
     {
         if (requireDebug)
             printf("require: %s does not exist\n", filename);
+        requireStatsAdd(REQUIRE_STAT_MISS, 1);
         return -1;
     }
+    requireStatsAdd(REQUIRE_STAT_HIT, 1);
     switch (filestat.st_mode & S_IFMT)
     {
-        case S_IFREG:
-            if (requireDebug)
-                printf("require: file %s exists, size %llu bytes\n",
-                    filename, (unsigned long long)filestat.st_size);
-            return filestat.st_size;
-        case S_IFDIR:
-            if (requireDebug)
-                printf("require: directory %s exists\n",
-                    filename);
-            return 0;
-        default:
-            if (requireDebug)
-                printf("require: %s is a special file type\n",
-                    filename);
-            return -1;
+        case S_IFREG:
+            if (requireDebug)
+                printf("require: file %s exists, size %llu bytes\n",
+                    filename, (unsigned long long)filestat.st_size);
+            return filestat.st_size;
+        case S_IFDIR:
+            if (requireDebug)
+                printf("require: directory %s exists\n",
+                    filename);
+            return 0;
+        default:
+            if (requireDebug)
+                printf("require: %s is a special file type\n",
+                    filename);
+            return -1;
+    }
+}
+#define fileExists(filename) (fileSize(filename)>=0)
+#define fileNotEmpty(filename) (fileSize(filename)>0)
+
+/* batched file checks
+A module release directory is probed for a whole list of candidate files
+(dbd file, startup script snippets) of which the first one found is used.
+On network file systems each stat costs a round trip. On Linux with
+io_uring, tryFiles submits all candidates at once as IORING_OP_STATX
+requests and waits for all results, so the round trips overlap.
+This is done only on network file systems, where it saves round trips.
+On local file systems handing the requests to kernel workers costs more
+than it saves. REQUIRE_IO_URING=always or =no overrides this decision.
+Without io_uring (old kernel or headers, seccomp) the candidates are
+checked one by one as before.
+*/
+
+typedef struct fileCandidate {
+    const char* format;     /* appended to the directory, up to two %s */
+    int arg1, arg2;         /* indices into the argument list */
+} fileCandidate;
+
+#if defined (__linux) && defined (STATX_TYPE) && defined (__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/vfs.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+/* IORING_OP_STATX is an enum, IORING_FEAT_CUR_PERSONALITY came with it in Linux 5.6 */
+#if defined (__NR_io_uring_setup) && defined (IORING_FEAT_CUR_PERSONALITY)
+#define REQUIRE_IO_URING
+#endif
+#endif
+#endif
+
+#ifdef REQUIRE_IO_URING
+#define URING_ENTRIES 64
+
+static struct {
+    int state;              /* 0: not yet tried, 1: ready, -1: not available */
+    int fd;
+    unsigned *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    unsigned entries;
+    struct io_uring_sqe* sqes;
+    struct io_uring_cqe* cqes;
+    void *sqRing, *cqRing;  /* mappings, MAP_FAILED if not mapped */
+    size_t sqRingSize, cqRingSize, sqesSize;
+} uring;
+
+static void uringDisable(const char* why)
+{
+    if (requireDebug)
+        printf("require: io_uring not used: %s\n", why);
+    if (uring.sqRing && uring.sqRing != MAP_FAILED) munmap(uring.sqRing, uring.sqRingSize);
+    if (uring.cqRing && uring.cqRing != MAP_FAILED) munmap(uring.cqRing, uring.cqRingSize);
+    if (uring.sqes && (void*)uring.sqes != MAP_FAILED) munmap(uring.sqes, uring.sqesSize);
+    uring.sqRing = uring.cqRing = NULL;
+    uring.sqes = NULL;
+    uring.cqes = NULL;
+    if (uring.fd > 0) close(uring.fd);
+    uring.fd = -1;
+    uring.state = -1;
+}
+
+static int uringInit(void)
+{
+    struct io_uring_params params;
+    char *sq, *cq;
+    const char* mode;
+
+    if (uring.state) return uring.state > 0 ? 0 : -1;
+    mode = getenv("REQUIRE_IO_URING");
+    if (mode && strcmp(mode, "no") == 0)
+    {
+        uringDisable("REQUIRE_IO_URING=no");
+        return -1;
+    }
+    memset(&params, 0, sizeof(params));
+    uring.fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (uring.fd < 0)
+    {
+        uringDisable(strerror(errno));
+        return -1;
+    }
+    fcntl(uring.fd, F_SETFD, FD_CLOEXEC);
+    uring.sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    uring.cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring.sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring.sqRing = mmap(NULL, uring.sqRingSize,
+        PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, uring.fd, IORING_OFF_SQ_RING);
+    uring.cqRing = mmap(NULL, uring.cqRingSize,
+        PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, uring.fd, IORING_OFF_CQ_RING);
+    uring.sqes = mmap(NULL, uring.sqesSize,
+        PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, uring.fd, IORING_OFF_SQES);
+    if (uring.sqRing == MAP_FAILED || uring.cqRing == MAP_FAILED || (void*)uring.sqes == MAP_FAILED)
+    {
+        uringDisable(strerror(errno));
+        return -1;
+    }
+    sq = uring.sqRing;
+    cq = uring.cqRing;
+    uring.sqTail = (unsigned*)(sq + params.sq_off.tail);
+    uring.sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+    uring.sqArray = (unsigned*)(sq + params.sq_off.array);
+    uring.cqHead = (unsigned*)(cq + params.cq_off.head);
+    uring.cqTail = (unsigned*)(cq + params.cq_off.tail);
+    uring.cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+    uring.cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    uring.entries = params.sq_entries;
+    uring.state = 1;
+    return 0;
+}
+
+/* statx all n paths (stride bytes apart) in one batch, result in size[] like fileSize */
+static int uringFileSizes(const char* paths, size_t stride, int n, off_t* size)
+{
+    struct statx* stx;
+    int* res;
+    unsigned tail, head;
+    int i, done;
+
+    if (n > (int)uring.entries) return -1;
+    stx = calloc(n, sizeof(struct statx) + sizeof(int));
+    if (!stx) return -1;
+    res = (int*)(stx + n);
+
+    tail = *uring.sqTail;
+    for (i = 0; i < n; i++)
+    {
+        unsigned index = tail++ & *uring.sqMask;
+        struct io_uring_sqe* sqe = &uring.sqes[index];
+
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)(paths + i * stride);
+        sqe->len = STATX_TYPE | STATX_SIZE;
+        sqe->off = (unsigned long)&stx[i];
+        sqe->user_data = i;
+        uring.sqArray[index] = index;
+    }
+    __atomic_store_n(uring.sqTail, tail, __ATOMIC_RELEASE);
+
+    head = *uring.cqHead;
+    for (done = 0; done < n;)
+    {
+        struct io_uring_cqe* cqe;
+
+        if (head == __atomic_load_n(uring.cqTail, __ATOMIC_ACQUIRE))
+        {
+            /* first call submits the batch, all calls wait for the rest */
+            if (syscall(__NR_io_uring_enter, uring.fd, done ? 0 : n, n - done,
+                IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+            {
+                /* ring state unknown now, better not use it again */
+                uringDisable(strerror(errno));
+                free(stx);
+                return -1;
+            }
+            continue;
+        }
+        cqe = &uring.cqes[head++ & *uring.cqMask];
+        if (cqe->user_data < (unsigned)n)
+        {
+            res[cqe->user_data] = cqe->res;
+            done++;
+        }
+    }
+    __atomic_store_n(uring.cqHead, head, __ATOMIC_RELEASE);
+
+    for (i = 0; i < n; i++)
+    {
+        if (res[i] == -EINVAL)
+        {
+            /* kernel without IORING_OP_STATX */
+            uringDisable("no statx support");
+            free(stx);
+            return -1;
+        }
+        if (res[i] < 0)
+            size[i] = -1;
+        else if (S_ISREG(stx[i].stx_mode))
+            size[i] = stx[i].stx_size;
+        else if (S_ISDIR(stx[i].stx_mode))
+            size[i] = 0;
+        else
+            size[i] = -1;
+    }
+    free(stx);
+    return 0;
+}
+
+/* only network file systems have round trips worth saving, local ones get slower */
+static int uringWorthwhile(const char* dir)
+{
+    static struct { dev_t dev; int remote; } devices[16];
+    static int ndevices;
+    const char* mode = getenv("REQUIRE_IO_URING");
+    struct stat filestat;
+    struct statfs fs;
+    int i, remote;
+
+    if (mode && strcmp(mode, "always") == 0) return 1;
+    if (stat(dir, &filestat) != 0) return 0;
+    for (i = 0; i < ndevices; i++)
+        if (devices[i].dev == filestat.st_dev) return devices[i].remote;
+    remote = statfs(dir, &fs) == 0 && (
+        fs.f_type == 0x6969 ||      /* NFS */
+        fs.f_type == 0xFF534D42 ||  /* CIFS */
+        fs.f_type == 0xFE534D42 ||  /* SMB2 */
+        fs.f_type == 0x517B ||      /* SMB */
+        fs.f_type == 0x5346414F ||  /* AFS */
+        fs.f_type == 0x00C36400 ||  /* Ceph */
+        fs.f_type == 0x65735546);   /* FUSE, e.g. sshfs */
+    if (requireDebug)
+        printf("require: %s is on a %s file system\n", dir, remote ? "network" : "local");
+    if (ndevices < (int)(sizeof(devices)/sizeof(devices[0])))
+    {
+        devices[ndevices].dev = filestat.st_dev;
+        devices[ndevices].remote = remote;
+        ndevices++;
+    }
+    return remote;
+}
+
+static double monotonicMs(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+#endif
+
+/* check candidates in order, leave the first existing (or non-empty) one in filename */
+static int tryFiles(char* filename, size_t size, size_t offs, int nonempty,
+    const fileCandidate* candidates, int n, const char* const* args)
+{
+    int i;
+
+#ifdef REQUIRE_IO_URING
+    char dir[PATH_MAX];
+
+    if (offs > 0 && offs < sizeof(dir))
+    {
+        memcpy(dir, filename, offs);
+        dir[offs] = 0;
+    }
+    else strcpy(dir, ".");
+    if (n > 1 && uringWorthwhile(dir) && uringInit() == 0)
+    {
+        char* paths = malloc(n * size);
+        off_t* sizes = malloc(n * sizeof(off_t));
+        double start = 0;
+        int found = -1;
+
+        if (requireDebug) start = monotonicMs();
+        for (i = 0; paths && i < n; i++)
+        {
+            memcpy(paths + i * size, filename, offs);
+            snprintf(paths + i * size + offs, size - offs, candidates[i].format,
+                args[candidates[i].arg1], args[candidates[i].arg2]);
+        }
+        if (paths && sizes && uringFileSizes(paths, size, n, sizes) == 0)
+        {
+            for (i = 0; i < n; i++)
+                if (sizes[i] > 0 || (sizes[i] == 0 && !nonempty)) break;
+            found = i < n;
+            /* count and report like one by one checks would */
+            requireStatsAdd(REQUIRE_STAT_MISS, found ? i : n);
+            if (found) requireStatsAdd(REQUIRE_STAT_HIT, 1);
+            if (requireDebug)
+            {
+                double batch = monotonicMs() - start;
+                int j;
+
+                for (j = 0; j < n && j <= i; j++)
+                {
+                    if (sizes[j] < 0)
+                        printf("require: %s does not exist\n", paths + j * size);
+                    else
+                        printf("require: %s exists, size %llu bytes\n",
+                            paths + j * size, (unsigned long long)sizes[j]);
+                }
+                printf("require: batch of %d file checks took %.3f ms\n", n, batch);
+            }
+            if (found) strcpy(filename, paths + i * size);
+        }
+        free(sizes);
+        free(paths);
+        if (found >= 0) return found;
+    }
+#endif
+    for (i = 0; i < n; i++)
+    {
+        snprintf(filename + offs, size - offs, candidates[i].format,
+            args[candidates[i].arg1], args[candidates[i].arg2]);
+        if (nonempty ? fileNotEmpty(filename) : fileExists(filename)) return 1;
+    }
+    return 0;
+}
+
+/* indices into the argument list of the candidate tables */
+enum { ARG_MODULE, ARG_VERSIONSTR, ARG_ARCH, ARG_RELEASE, ARG_BASETYPE, ARG_OSCLASS };
+
+/* module dbd file, relative to the release directory */
+static const fileCandidate moduleDbdFiles[] = {
+    { "dbd/%s%s.dbd", ARG_MODULE, ARG_VERSIONSTR },
+    { "%s%s.dbd", ARG_MODULE, ARG_VERSIONSTR },
+    { "../dbd/%s%s.dbd", ARG_MODULE, ARG_VERSIONSTR },
+    { "../%s%s.dbd", ARG_MODULE, ARG_VERSIONSTR },
+    { "../../dbd/%s.dbd", ARG_MODULE, ARG_MODULE }, /* org EPICSbase */
+};
+
+/* startup script snippets in order of preference */
+static const fileCandidate startupScripts[] = {
+    { "%s-%s.iocsh", ARG_ARCH, ARG_RELEASE },
+    { "../%s-%s.iocsh", ARG_ARCH, ARG_RELEASE },
+    { "%s-%s.cmd", ARG_ARCH, ARG_RELEASE },
+    { "../%s-%s.cmd", ARG_ARCH, ARG_RELEASE },
+    { "%s-%s.iocsh", ARG_ARCH, ARG_BASETYPE },
+    { "../%s-%s.iocsh", ARG_ARCH, ARG_BASETYPE },
+    { "%s-%s.cmd", ARG_ARCH, ARG_BASETYPE },
+    { "../%s-%s.cmd", ARG_ARCH, ARG_BASETYPE },
+    { "%s-%s.iocsh", ARG_OSCLASS, ARG_RELEASE },
+    { "../%s-%s.iocsh", ARG_OSCLASS, ARG_RELEASE },
+    { "%s-%s.cmd", ARG_OSCLASS, ARG_RELEASE },
+    { "../%s-%s.cmd", ARG_OSCLASS, ARG_RELEASE },
+    { "%s-%s.iocsh", ARG_OSCLASS, ARG_BASETYPE },
+    { "../%s-%s.iocsh", ARG_OSCLASS, ARG_BASETYPE },
+    { "%s-%s.cmd", ARG_OSCLASS, ARG_BASETYPE },
+    { "../%s-%s.cmd", ARG_OSCLASS, ARG_BASETYPE },
+    { "startup-%s.iocsh", ARG_RELEASE, ARG_RELEASE },
+    { "../startup-%s.iocsh", ARG_RELEASE, ARG_RELEASE },
+    { "startup-%s.cmd", ARG_RELEASE, ARG_RELEASE },
+    { "../startup-%s.cmd", ARG_RELEASE, ARG_RELEASE },
+    { "startup-%s.iocsh", ARG_BASETYPE, ARG_BASETYPE },
+    { "../startup-%s.iocsh", ARG_BASETYPE, ARG_BASETYPE },
+    { "startup-%s.cmd", ARG_BASETYPE, ARG_BASETYPE },
+    { "../startup-%s.cmd", ARG_BASETYPE, ARG_BASETYPE },
+    { "%s.iocsh", ARG_ARCH, ARG_ARCH },
+    { "../%s.iocsh", ARG_ARCH, ARG_ARCH },
+    { "%s.cmd", ARG_ARCH, ARG_ARCH },
+    { "../%s.cmd", ARG_ARCH, ARG_ARCH },
+    { "%s.iocsh", ARG_OSCLASS, ARG_OSCLASS },
+    { "../%s.iocsh", ARG_OSCLASS, ARG_OSCLASS },
+    { "%s.cmd", ARG_OSCLASS, ARG_OSCLASS },
+    { "../%s.cmd", ARG_OSCLASS, ARG_OSCLASS },
+    { "startup.iocsh", ARG_ARCH, ARG_ARCH },
+    { "../startup.iocsh", ARG_ARCH, ARG_ARCH },
+    { "startup.cmd", ARG_ARCH, ARG_ARCH },
+    { "../startup.cmd", ARG_ARCH, ARG_ARCH },
+};
+
+/* dbd bundle
+If REQUIRE_DBD_BUNDLE names an existing dbd file made with bundleDBD.pl,
+it is loaded with a single dbLoadDatabase call when the first module
+listed in its header is required. For all listed modules with exactly
+the same version, the module dbd file is then not searched and loaded.
+The header lists version, EPICS release, modification time and path of
+each module dbd file. The bundle is not used at all if any of the files
+changed, the release differs or an already loaded module has another
+version. A module required later is loaded with its own dbd file if its
+version or directory differs from the bundle.
+If the bundle does not exist, the loaded module dbd files are written
+to <bundle>.modules, the input for bundleDBD.pl.
+*/
+
+typedef struct bundleModule
+{
+    struct bundleModule* next;
+    int required;
+    long long mtime;
+    char* version;
+    char* release;
+    char* dbdfile;
+    char name[1];
+} bundleModule;
+
+static struct
+{
+    int state;              /* 0: not checked, 1: available, 2: loaded, -1: not available */
+    char* filename;
+    FILE* modulesFile;
+    bundleModule* modules;
+} dbdBundle;
+
+static void dbdBundleInit(void)
+{
+    const char* filename = getenv("REQUIRE_DBD_BUNDLE");
+    FILE* file;
+    char line[PATH_MAX+256];
+
+    dbdBundle.state = -1;
+    if (!filename || !filename[0]) return;
+    if ((dbdBundle.filename = strdup(filename)) == NULL) return;
+    if ((file = fopen(filename, "r")) == NULL)
+    {
+        if (requireDebug)
+            printf("require: no dbd bundle %s\n", filename);
+        return;
+    }
+    while (fgets(line, sizeof(line), file) && strncmp(line, "#!module ", 9) == 0)
+    {
+        char name[100], version[100], release[100];
+        long long mtime;
+        int n = 0;
+        bundleModule* m;
+
+        line[strcspn(line, "\r\n")] = 0;
+        if (sscanf(line+9, "%99s %99s %99s %lld %n", name, version, release, &mtime, &n) != 4 || !n || !line[9+n])
+        {
+            fprintf(stderr, "Dbd bundle %s has a bad header line \"%s\", not using it\n",
+                filename, line);
+            fclose(file);
+            return;
+        }
+        m = calloc(1, sizeof(bundleModule) + strlen(name) + strlen(version) + strlen(release) + strlen(line+9+n) + 3);
+        if (!m) break;
+        strcpy(m->name, name);
+        m->version = m->name + strlen(name) + 1;
+        strcpy(m->version, version);
+        m->release = m->version + strlen(version) + 1;
+        strcpy(m->release, release);
+        m->dbdfile = m->release + strlen(release) + 1;
+        strcpy(m->dbdfile, line+9+n);
+        m->mtime = mtime;
+        m->next = dbdBundle.modules;
+        dbdBundle.modules = m;
+        if (requireDebug)
+            printf("require: dbd bundle %s has %s %s %s %s\n", filename, name, version, release, m->dbdfile);
+    }
+    fclose(file);
+    dbdBundle.state = 1;
+}
+
+/* Check that the dbd file of a bundle entry is still the one in the bundle */
+static int dbdBundleEntryValid(bundleModule* m)
+{
+    struct stat filestat;
+
+    if (strcmp(m->release, epicsRelease) != 0)
+    {
+        printf("Dbd bundle %s has %s for EPICS %s, not %s\n",
+            dbdBundle.filename, m->name, m->release, epicsRelease);
+        return 0;
+    }
+    if (stat(m->dbdfile, &filestat) != 0)
+    {
+        printf("Dbd bundle %s has %s from %s, which is not readable: %s\n",
+            dbdBundle.filename, m->name, m->dbdfile, strerror(errno));
+        return 0;
+    }
+    if ((long long)filestat.st_mtime != m->mtime)
+    {
+        printf("Dbd bundle %s has %s from %s, which has changed\n",
+            dbdBundle.filename, m->name, m->dbdfile);
+        return 0;
+    }
+    return 1;
+}
+
+/* Check all entries before loading the bundle */
+static int dbdBundleValid(void)
+{
+    bundleModule* m;
+    const char* loaded;
+
+    for (m = dbdBundle.modules; m; m = m->next)
+    {
+        if (!dbdBundleEntryValid(m)) return 0;
+        if ((loaded = getLibVersion(m->name)) != NULL && strcmp(loaded, m->version) != 0)
+        {
+            printf("Dbd bundle %s has %s version %s, but version %s is loaded\n",
+                dbdBundle.filename, m->name, m->version, loaded);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Returns 1 if the bundle has the module dbd, 0 if not, -1 on error.
+   The dbd file must be in the directory of the loaded library up to dirlen.
+*/
+static int dbdBundleLoad(const char* module, const char* version, const char* libfile, size_t dirlen)
+{
+    bundleModule* m;
+
+    if (dbdBundle.state == 0) dbdBundleInit();
+    if (dbdBundle.state < 0 || !version) return 0;
+    for (m = dbdBundle.modules; m; m = m->next)
+        if (strcmp(m->name, module) == 0) break;
+    if (!m) return 0;
+    if (strcmp(m->version, version) != 0)
+    {
+        printf("Dbd bundle %s has %s version %s, not %s\n",
+            dbdBundle.filename, module, m->version, version);
+        return 0;
+    }
+    if (strncmp(m->dbdfile, libfile, dirlen) != 0)
+    {
+        printf("Dbd bundle %s has %s from %s, not from %.*s\n",
+            dbdBundle.filename, module, m->dbdfile, (int)dirlen, libfile);
+        return 0;
+    }
+    if (dbdBundle.state == 2)
+    {
+        if (!dbdBundleEntryValid(m)) return 0;
+        m->required = 1;
+        if (requireDebug)
+            printf("require: dbd of %s already loaded with bundle\n", module);
+        return 1;
+    }
+    if (!dbdBundleValid())
+    {
+        printf("Not using dbd bundle %s\n", dbdBundle.filename);
+        dbdBundle.state = -1;
+        return 0;
+    }
+    m->required = 1;
+    printf("Loading dbd bundle %s\n", dbdBundle.filename);
+    REQUIRE_PROBE3(dbd_load_start, module, version, dbdBundle.filename);
+    if (dbLoadDatabase(dbdBundle.filename, NULL, NULL) != 0)
+    {
+        fprintf (stderr, "Error loading %s\n", dbdBundle.filename);
+        return -1;
+    }
+    REQUIRE_PROBE3(dbd_load_end, module, version, dbdBundle.filename);
+    dbdBundle.state = 2;
+    return 1;
+}
+
+/* Write module dbd files loaded individually as input for bundleDBD.pl */
+static void dbdBundleRecord(const char* module, const char* version, const char* dbdfile)
+{
+    if (dbdBundle.state != -1 || !dbdBundle.filename) return;
+    if (!dbdBundle.modulesFile)
+    {
+        char* listname;
+        if (asprintf(&listname, "%s.modules", dbdBundle.filename) < 0) return;
+        dbdBundle.modulesFile = fopen(listname, "w");
+        if (!dbdBundle.modulesFile)
+        {
+            perror(listname);
+            free(dbdBundle.filename);
+            dbdBundle.filename = NULL;
+        }
+        else if (requireDebug)
+            printf("require: writing module dbd files to %s\n", listname);
+        free(listname);
+        if (!dbdBundle.modulesFile) return;
+    }
+    fprintf(dbdBundle.modulesFile, "%s %s %s %s\n", module, version ? version : "-", epicsRelease, dbdfile);
+    fflush(dbdBundle.modulesFile);
+}
+
+static void dbdBundleCheck(initHookState state)
+{
+    bundleModule* m;
+
+    if (state != initHookAtBeginning || dbdBundle.state != 2) return;
+    for (m = dbdBundle.modules; m; m = m->next)
+        if (!m->required)
+            fprintf(stderr, "Warning: dbd bundle %s contains %s %s, which has not been required\n",
+                dbdBundle.filename, m->name, m->version);
+}
+
+#ifdef __linux
+#include <signal.h>
+/*
+The iocsh launcher option -dps profiles the IOC startup with perf
+and passes the pid of perf in REQUIRE_PROFILE_PID.
+Stop the recording as soon as iocInit has finished.
+*/
+static void profileStop(initHookState state)
+{
+    const char* pidstr;
+    long pid;
+
+    if (state != initHookAfterInterruptAccept) return;
+    pidstr = getenv("REQUIRE_PROFILE_PID");
+    if (!pidstr) return;
+    pid = strtol(pidstr, NULL, 10);
+    if (pid <= 0) return;
+    if (kill(pid, SIGINT) != 0)
+        fprintf(stderr, "Cannot stop startup profiler pid %ld: %s\n", pid, strerror(errno));
+    else if (requireDebug)
+        printf("require: stopped startup profiler pid %ld\n", pid);
+}
+#endif
+
+static void loadModuleRecords(const char* module, const char* version, long originSize)
+{
+    const char* mylocation;
+    char* templatefile;
+    char* argstring;
+
+    /* create a record with the version string */
+    mylocation = getenv("require_DIR");
+    if (mylocation == NULL) return;
+    if (asprintf(&templatefile, "%s/db/moduleversion.template", mylocation) < 0) return;
+    if (asprintf(&argstring, "IOC=%.30s, MODULE=%.24s, VERSION=%.39s, MODULE_COUNT=%lu, BUFFER_SIZE=%lu, ORIGIN_SIZE=%ld",
+        getenv("IOC"), module, version, moduleCount + deferredCount,
+        moduleListBufferSize + deferredBufferSize +
+        (maxModuleNameLength > deferredNameLength ? maxModuleNameLength : deferredNameLength) * (moduleCount + deferredCount),
+        originSize) < 0)
+    {
+        free(templatefile);
+        return;
     }
+    printf("Loading module info records for %s\n", module);
+    dbLoadRecords(templatefile, argstring);
+    free(argstring);
+    free(templatefile);
 }
-#define fileExists(filename) (fileSize(filename)>=0)
-#define fileNotEmpty(filename) (fileSize(filename)>0)
 
-void registerModule(const char* module, const char* version, const char* location)
+static void registerModule_priv(const char* module, const char* version, const char* location)
 {
     moduleitem *m, **pm;
     size_t lm = strlen(module) + 1;
     size_t lv = (version ? strlen(version) : 0) + 1;
     size_t ll = 1;
     char* abslocation = NULL;
-    char* argstring = NULL;
     int addSlash=0;
-    const char *mylocation;
     static int firstTime = 1;
     off_t originSize = 0;
     char* originStr = NULL;
 
     if (requireDebug)
-        printf("require: registerModule(%s,%s,%s)\n", module, version, location);
+        printf("require: registerModule(%s,%s,%s)\n", module, version, location ? location : "");
 
     if (firstTime)
     {
@@ -684,6 +2372,10 @@ void registerModule(const char* module, const char* version, const char* locatio
 #endif
         {
             initHookRegister(fillModuleListRecord);
+            initHookRegister(dbdBundleCheck);
+#ifdef __linux
+            initHookRegister(profileStop);
+#endif
             if (requireDebug)
                 printf("require: initHookRegister\n");
         }
@@ -738,14 +2430,18 @@ void registerModule(const char* module, const char* version, const char* locatio
     if (originStr) strcpy (m->content+lm+lv+ll+addSlash, originStr);
     free(originStr);
     if (abslocation != location) free(abslocation);
-    for (pm = &loadedModules; *pm != NULL; pm = &(*pm)->next);
-    *pm = m;
     if (lm > maxModuleNameLength) maxModuleNameLength = lm;
     if (lv > maxVersionLength) maxVersionLength = lv;
     if (ll > maxLocationLength) maxLocationLength = ll;
+    for (pm = &loadedModules; MODULE_NEXT(*pm) != NULL; pm = &(*pm)->next);
+    MODULE_PUBLISH(*pm, m);
     moduleListBufferSize += lv;
     moduleCount++;
 
+    /* the deferred thread must not change the environment and SCRIPT_PATH
+       while the shell reads them, see requireDeferred */
+    if (deferredActive) return;
+
     putenvprintf("MODULE=%s", module);
     putenvprintf("%s_VERSION=%s", module, version);
     if (location)
@@ -758,17 +2454,18 @@ void registerModule(const char* module, const char* version, const char* locatio
     /* only do registration register stuff at init */
     if (interruptAccept) return;
 
-    /* create a record with the version string */
-    mylocation = getenv("require_DIR");
-    if (mylocation == NULL) return;
-    if (asprintf(&abslocation, "%s/db/moduleversion.template", mylocation) < 0) return;
-    if (asprintf(&argstring, "IOC=%.30s, MODULE=%.24s, VERSION=%.39s, MODULE_COUNT=%lu, BUFFER_SIZE=%lu, ORIGIN_SIZE=%ld",
-        getenv("IOC"), module, version, moduleCount,
-        moduleListBufferSize+maxModuleNameLength*moduleCount, (long)originSize) < 0) return;
-    printf("Loading module info records for %s\n", module);
-    dbLoadRecords(abslocation, argstring);
-    free(argstring);
-    free(abslocation);
+    /* a fork server leaves the records to the forked IOCs */
+    if (getenv("REQUIRE_FORK_SERVER")) return;
+
+    loadModuleRecords(module, version, (long)originSize);
+}
+
+void registerModule(const char* module, const char* version, const char* location)
+{
+    REQUIRE_LOCK_INIT();
+    REQUIRE_LOCK();
+    registerModule_priv(module, version, location);
+    REQUIRE_UNLOCK();
 }
 
 #if defined (vxWorks)
@@ -803,50 +2500,176 @@ void registerExternalModules()
 }
 
 #elif defined (__linux)
-/* This is the Linux link.h, not the EPICS link.h ! */
-#include <link.h>
+
+/* Number of symbols in the dynamic symbol table from DT_GNU_HASH.
+   The table has no explicit size, the last chain ends with bit 0 set. */
+static size_t gnuHashSymbolCount(const Elf32_Word* gnuhash)
+{
+    Elf32_Word nbuckets = gnuhash[0];
+    Elf32_Word symoffset = gnuhash[1];
+    Elf32_Word bloomsize = gnuhash[2];
+    const Elf32_Word* buckets = (const Elf32_Word*)((const ElfW(Addr)*)(gnuhash+4) + bloomsize);
+    const Elf32_Word* chain = buckets + nbuckets;
+    Elf32_Word last = 0;
+    Elf32_Word i;
+
+    for (i = 0; i < nbuckets; i++)
+        if (buckets[i] > last) last = buckets[i];
+    if (last < symoffset) return symoffset;
+    while (!(chain[last - symoffset] & 1)) last++;
+    return last + 1;
+}
+
+/* Location "<pool>/<module>/<version>/R<release>/" of a library installed
+   as "<location>lib/<arch>/lib<module>.so" in the module pool, else NULL.
+   Libraries outside of the pool layout (e.g. in /usr/lib) get no location. */
+static char* poolLocation(const char* libpath, const char* module, size_t lm, const char* version)
+{
+    const char* end[6];
+    const char* p = libpath + strlen(libpath);
+    size_t lv = strlen(version);
+    size_t la = strlen(targetArch);
+    int i;
+    char* location;
+
+    /* end[0]: end of file name, end[1]: end of <arch>, ... end[5]: end of <pool> */
+    end[0] = p;
+    for (i = 1; i < 6; i++)
+    {
+        while (p > libpath && p[-1] != '/') p--;
+        if (p == libpath) return NULL;
+        end[i] = --p;
+    }
+    if (end[0] - end[1] - 1 < (long)lm + 4 ||
+        strncmp(end[1] + 1, "lib", 3) != 0 || strncmp(end[1] + 4, module, lm) != 0 ||
+        end[1][4 + lm] != '.') return NULL;                 /* lib<module>.so... */
+    if (end[1] - end[2] - 1 != (long)la || strncmp(end[2] + 1, targetArch, la) != 0) return NULL;
+    if (end[2] - end[3] - 1 != (long)strlen(LIBDIR) || strncmp(end[3] + 1, LIBDIR, strlen(LIBDIR)) != 0) return NULL;
+    if (end[3] - end[4] < 3 || end[4][1] != 'R') return NULL;
+    if (end[4] - end[5] - 1 != (long)lv || strncmp(end[5] + 1, version, lv) != 0) return NULL;
+    if (end[5] - libpath < (long)lm || strncmp(end[5] - lm, module, lm) != 0 ||
+        (end[5] - lm != libpath && end[5][-(long)lm-1] != '/')) return NULL;
+    location = malloc(end[3] - libpath + 2);
+    if (!location) return NULL;
+    memcpy(location, libpath, end[3] - libpath + 1);        /* "<location>/" up to R<release>/ */
+    location[end[3] - libpath + 1] = 0;
+    return location;
+}
 
 static int findLibRelease (
     struct dl_phdr_info *info, /* shared library info */
     size_t size,               /* size of info structure */
     void *data                 /* user-supplied arg */
 ) {
-    void *handle;
-    char* location = NULL;
-    char* p;
-    char* version;
-    char* symname;
-    char name[PATH_MAX + 11];                               /* get space for library path + "LibRelease" */
+    const ElfW(Dyn)* dyn = NULL;
+    const ElfW(Sym)* symtab = NULL;
+    const char* strtab = NULL;
+    const Elf32_Word* gnuhash = NULL;
+    const Elf32_Word* hash = NULL;
+    const ElfW(Ehdr)* ehdr = NULL;
+    ElfW(Addr) lo = ~(ElfW(Addr))0, hi = 0;
+    const char* libname = NULL;
+    size_t libnamelen = 0;
+    size_t nsyms;
+    size_t i;
 
-    (void)data;                                             /* unused */
     if (size < sizeof(struct dl_phdr_info)) return 0;       /* wrong version of struct dl_phdr_info */
-    /* find a symbol with a name like "_<module>LibRelease"
-       where <module> is from the library name "<location>/lib<module>.so" */
-    if (info->dlpi_name == NULL || info->dlpi_name[0] == 0) return 0;  /* no library name */
-    strcpy(name, info->dlpi_name);                          /* get a modifiable copy of the library name */
-    handle = dlopen(info->dlpi_name, RTLD_LAZY);            /* re-open already loaded library */
-    p = strrchr(name, '/');                                 /* find file name part in "<location>/lib<module>.so" */
-    if (p) {location = name; *++p=0;} else p=name;          /* terminate "<location>/" (if exists) */
-    *(symname = p+2) = '_';                                 /* replace "lib" with "_" */
-    p = strchr(symname, '.');                               /* find ".so" extension */
-    if (p == NULL) p = symname + strlen(symname);           /* no file extension ? */
-    strcpy(p, "LibRelease");                                /* append "LibRelease" to module name */
-    version = dlsym(handle, symname);                       /* find symbol "_<module>LibRelease" */
-    if (version)
+    /* the program itself (without name) in the second pass only */
+    if ((!info->dlpi_name || !info->dlpi_name[0]) != *(int*)data) return 0;
+
+    /* find symbols with a name like "_<module>LibRelease" in the dynamic symbol table
+       without re-opening the library with dlopen */
+    for (i = 0; i < info->dlpi_phnum; i++)
+    {
+        const ElfW(Phdr)* phdr = &info->dlpi_phdr[i];
+
+        if (phdr->p_type == PT_DYNAMIC)
+            dyn = (const ElfW(Dyn)*)(info->dlpi_addr + phdr->p_vaddr);
+        if (phdr->p_type == PT_LOAD)
+        {
+            if (phdr->p_offset == 0)                        /* the ELF header is mapped here */
+                ehdr = (const ElfW(Ehdr)*)(info->dlpi_addr + phdr->p_vaddr);
+            if (phdr->p_vaddr < lo) lo = phdr->p_vaddr;
+            if (phdr->p_vaddr + phdr->p_memsz > hi) hi = phdr->p_vaddr + phdr->p_memsz;
+        }
+    }
+    if (dyn == NULL || ehdr == NULL) return 0;              /* no dynamic section */
+    if (ehdr->e_type != ET_EXEC && ehdr->e_type != ET_DYN) return 0;
+    for (; dyn->d_tag != DT_NULL; dyn++)
+    {
+        /* Addresses in an ET_EXEC (non-PIE) program are absolute.
+           In an ET_DYN object they are relative to its load address,
+           unless the dynamic loader has relocated them in place (as glibc
+           does on most, but not all architectures). Relocated addresses
+           point into the mapped segments, relative ones do not. */
+        ElfW(Addr) addr = dyn->d_un.d_ptr;
+        if (ehdr->e_type == ET_DYN &&
+            !(addr >= info->dlpi_addr + lo && addr < info->dlpi_addr + hi))
+            addr += info->dlpi_addr;
+        switch (dyn->d_tag)
+        {
+            case DT_SYMTAB:   symtab = (const ElfW(Sym)*)addr; break;
+            case DT_STRTAB:   strtab = (const char*)addr; break;
+            case DT_GNU_HASH: gnuhash = (const Elf32_Word*)addr; break;
+            case DT_HASH:     hash = (const Elf32_Word*)addr; break;
+        }
+    }
+    if (!symtab || !strtab) return 0;
+    if (hash) nsyms = hash[1];                              /* nchain equals number of symbols */
+    else if (gnuhash) nsyms = gnuHashSymbolCount(gnuhash);
+    else return 0;
+
+    if (info->dlpi_name && info->dlpi_name[0])
+    {
+        /* module name from the library name "<location>/lib<module>.so" */
+        libname = strrchr(info->dlpi_name, '/');
+        libname = libname ? libname+1 : info->dlpi_name;
+        if (strncmp(libname, "lib", 3) == 0) libname += 3;
+        libnamelen = strcspn(libname, ".");
+    }
+
+    for (i = 0; i < nsyms; i++)
     {
-        *p=0; symname++;                                    /* get "<module>" from "_<module>LibRelease" */
-        if ((p = strstr(name, "/" LIBDIR "/" )) != NULL) p[1]=0; /* cut "<location>" before LIBDIR */
-        if (getLibVersion(symname) == NULL)
-            registerModule(symname, version, location);
+        const char* symname;
+        char* module;
+        size_t lm;
+
+        if (symtab[i].st_shndx == SHN_UNDEF) continue;      /* only defined symbols */
+        symname = strtab + symtab[i].st_name;
+        if (symname[0] != '_') continue;
+        lm = strlen(symname);
+        if (lm <= 11) continue;                             /* strlen("_LibRelease") */
+        lm -= 10;
+        if (strcmp(symname+lm, "LibRelease") != 0) continue;
+        module = strdup(symname+1);                         /* remove '_' */
+        if (!module) continue;
+        module[lm-1] = 0;                                   /* remove "LibRelease" */
+        if (getLibVersion(module) == NULL)
+        {
+            /* dlpi_addr is 0 for an ET_EXEC program, so this is right for both types */
+            const char* version = (const char*)(info->dlpi_addr + symtab[i].st_value);
+            char* location = NULL;
+
+            /* only the module named like the library is located in the library directory */
+            if (libname && lm-1 == libnamelen && strncmp(module, libname, libnamelen) == 0)
+                location = poolLocation(info->dlpi_name, module, libnamelen, version);
+            registerModule(module, version, location);
+            free(location);
+        }
+        free(module);
     }
-    dlclose(handle);
     return 0;
 }
 
 static void registerExternalModules()
 {
-    /* iterate over all loaded libraries */
-    dl_iterate_phdr(findLibRelease, NULL);
+    /* iterate over all loaded libraries, then over the program:
+       a non-PIE program has copies of the _<module>LibRelease variables it
+       references (copy relocations), but the libraries know their location */
+    int program = 0;
+    dl_iterate_phdr(findLibRelease, &program);
+    program = 1;
+    dl_iterate_phdr(findLibRelease, &program);
 }
 
 #elif defined (_WIN32)
@@ -940,7 +2763,7 @@ size_t foreachLoadedLib(size_t (*func)(const char* name, const char* version, co
     moduleitem* m;
     size_t result;
 
-    for (m = loadedModules; m; m=m->next)
+    for (m = MODULE_NEXT(loadedModules); m; m = MODULE_NEXT(m->next))
     {
         const char* name = m->content;
         const char* version = name + strlen(name)+1;
@@ -955,7 +2778,7 @@ const char* getLibVersion(const char* libname)
 {
     moduleitem* m;
 
-    for (m = loadedModules; m; m=m->next)
+    for (m = MODULE_NEXT(loadedModules); m; m = MODULE_NEXT(m->next))
     {
         if (strcmp(m->content, libname) == 0)
         {
@@ -970,7 +2793,7 @@ const char* getLibLocation(const char* libname)
     moduleitem* m;
     char *v;
 
-    for (m = loadedModules; m; m=m->next)
+    for (m = MODULE_NEXT(loadedModules); m; m = MODULE_NEXT(m->next))
     {
         if (strcmp(m->content, libname) == 0)
         {
@@ -998,7 +2821,7 @@ int libversionShow(const char* outfile)
             return -1;
         }
     }
-    for (m = loadedModules; m; m=m->next)
+    for (m = MODULE_NEXT(loadedModules); m; m = MODULE_NEXT(m->next))
     {
         lm = strlen(m->content)+1;
         lv = strlen(m->content+lm)+1;
@@ -1132,39 +2955,660 @@ static int compareVersions(const char* found, const char* request, int exactness
         }
         else
         {
-            if (requireDebug)
-                printf("require: compareVersions: HIGHER minor number\n");
-            return HIGHER;
+            if (requireDebug)
+                printf("require: compareVersions: HIGHER minor number\n");
+            return HIGHER;
+        }
+    }
+    if (req_parts == 2)
+    {
+        if (requireDebug)
+            printf("require: compareVersions: MATCH only major.minor number requested\n");
+        return MATCH;
+    }
+    if (found_patch < req_patch)
+    {
+        if (requireDebug)
+            printf("require: compareVersions: MISMATCH patch level too low\n");
+        return MISMATCH;
+    }
+    if (found_patch == req_patch)
+    {
+        if (requireDebug)
+            printf("require: compareVersions: MATCH patch level matches exactly requested\n");
+        return MATCH;
+    }
+    if (req_extra[0] == '+' && exactnessLevel <= 1)
+    {
+        if (requireDebug)
+            printf("require: compareVersions: MATCH patch level higher than requested with +\n");
+        return MATCH;
+    }
+    if (requireDebug)
+        printf("require: compareVersions: HIGHER patch level\n");
+    return HIGHER;
+}
+
+/* pool cache
+Linux only, opt-in: Many IOCs booting at the same time on one host search
+the same module directories of the pool. If REQUIRE_POOL_CACHE is set to a
+file name (e.g. /dev/shm/require.cache), the result of searching a module
+directory and the listing of its version directories are shared via this
+memory mapped file. The file must belong to the user and must not be
+writable by anyone else.
+A result is valid as long as the module directory and the directories of
+the versions that could change it (matching and not lower than the found
+one, each down to R<release>/lib/) did not change, but for at most
+POOL_CACHE_MAX_AGE seconds. A listing is valid as long as the module
+directory did not change.
+Each entry is protected by a sequence lock. Its 32 bit lock word holds the
+generation of the entry times 2 or, while being written, the pid of the
+writer times 2 plus 1, so that an entry left locked by a crashed writer
+can be taken over.
+*/
+
+#define POOL_CACHE_LISTING_SIZE 1024
+
+typedef struct poolCacheResult
+{
+    int exactnessLevel;
+    int someVersionFound;
+    int someArchFound;
+    int overflow;            /* too many relevant versions to cache */
+    unsigned long long stamp;
+    char found[64];
+    char relevant[192];      /* '/' separated versions the result depends on */
+} poolCacheResult;
+
+#if defined (__linux)
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <signal.h>
+
+#define POOL_CACHE_MAGIC 0x52514332 /* "RQC2" */
+#define POOL_CACHE_SLOTS 1024
+#define POOL_CACHE_WAYS 4
+#define POOL_CACHE_MAX_AGE 300
+
+typedef struct poolCacheEntry
+{
+    volatile unsigned int lock; /* generation*2 or writer pid*2+1 */
+    unsigned int generation;
+    unsigned int hash;
+    long created;
+    unsigned long long stamp;
+    union {
+        poolCacheResult result;
+        char listing[POOL_CACHE_LISTING_SIZE];
+    } u;
+    char key[512];
+} poolCacheEntry;
+
+typedef struct poolCache
+{
+    volatile unsigned int magic;
+    unsigned int slots;
+    unsigned int entrysize;
+    poolCacheEntry entries[POOL_CACHE_SLOTS];
+} poolCache;
+
+static poolCache* poolCacheGet(void)
+{
+    static poolCache* cache = NULL;
+    static int firstTime = 1;
+    const char* cachefile;
+    int fd;
+    struct stat st;
+
+    if (!firstTime) return cache;
+    firstTime = 0;
+    cachefile = getenv("REQUIRE_POOL_CACHE");
+    if (!cachefile || !cachefile[0]) return NULL;
+    fd = open(cachefile, O_RDWR|O_CREAT|O_NOFOLLOW|O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        perror(cachefile);
+        return NULL;
+    }
+    if (fstat(fd, &st) != 0)
+    {
+        perror(cachefile);
+        close(fd);
+        return NULL;
+    }
+    /* whoever can write the cache can redirect require to other modules */
+    if (!S_ISREG(st.st_mode) || st.st_uid != geteuid() || (st.st_mode & 022) != 0)
+    {
+        fprintf(stderr, "require: %s must be a file of user %d not writable by others\n",
+            cachefile, (int)geteuid());
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size < (off_t)sizeof(poolCache) && ftruncate(fd, sizeof(poolCache)) != 0)
+    {
+        perror(cachefile);
+        close(fd);
+        return NULL;
+    }
+    cache = mmap(NULL, sizeof(poolCache), PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (cache == MAP_FAILED)
+    {
+        perror(cachefile);
+        return cache = NULL;
+    }
+    if (cache->magic == 0)
+    {
+        cache->slots = POOL_CACHE_SLOTS;
+        cache->entrysize = sizeof(poolCacheEntry);
+        __sync_bool_compare_and_swap(&cache->magic, 0, POOL_CACHE_MAGIC);
+    }
+    if (cache->magic != POOL_CACHE_MAGIC || cache->slots != POOL_CACHE_SLOTS ||
+        cache->entrysize != sizeof(poolCacheEntry))
+    {
+        fprintf(stderr, "require: %s is not a compatible pool cache\n", cachefile);
+        munmap(cache, sizeof(poolCache));
+        return cache = NULL;
+    }
+    if (requireDebug)
+        printf("require: using pool cache %s\n", cachefile);
+    return cache;
+}
+
+/* names from a shared file end up in paths, allow no other directory */
+static int poolCacheValidName(const char* name)
+{
+    return name[0] != 0 && name[0] != '.' && strchr(name, '/') == NULL;
+}
+
+static unsigned int poolCacheHash(const char* key)
+{
+    unsigned int hash = 2166136261u; /* FNV-1a */
+    while (*key)
+    {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void poolCacheStampAdd(unsigned long long* stamp, const char* path)
+{
+    struct stat st;
+    unsigned long long values[3] = { 0, 0, 0 };
+    int i;
+
+    if (stat(path, &st) == 0)
+    {
+        values[0] = st.st_ino;
+        values[1] = st.st_mtim.tv_sec;
+        values[2] = st.st_mtim.tv_nsec;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        *stamp ^= values[i];
+        *stamp *= 1099511628211ull; /* FNV-1a 64 bit prime, per value */
+    }
+}
+
+/* stamp of the module directory "<dirname>/<module>/" with length len
+   and of the relevant version directories down to R<release>/lib/,
+   0 if the module directory does not exist */
+static unsigned long long poolCacheStamp(const char* moduledir, int len, const char* relevant)
+{
+    unsigned long long stamp = 14695981039346656037ull;
+    char path[PATH_MAX];
+    struct stat st;
+
+    snprintf(path, sizeof(path), "%.*s", len, moduledir);
+    if (stat(path, &st) != 0) return 0;
+    poolCacheStampAdd(&stamp, path);
+    while (relevant && *relevant)
+    {
+        int n = (int)strcspn(relevant, "/");
+        snprintf(path, sizeof(path), "%.*s%.*s/", len, moduledir, n, relevant);
+        poolCacheStampAdd(&stamp, path);
+        snprintf(path, sizeof(path), "%.*s%.*s/R%s/", len, moduledir, n, relevant, epicsRelease);
+        poolCacheStampAdd(&stamp, path);
+        snprintf(path, sizeof(path), "%.*s%.*s/R%s/" LIBDIR "/", len, moduledir, n, relevant, epicsRelease);
+        poolCacheStampAdd(&stamp, path);
+        relevant += n;
+        if (*relevant) relevant++;
+    }
+    return stamp ? stamp : 1;
+}
+
+/* find the entry of key and copy its value, 0 if not found */
+static int poolCacheRead(const char* key, void* value, size_t size, unsigned long long* stamp)
+{
+    poolCache* cache;
+    poolCacheEntry* e;
+    unsigned int hash;
+    int i;
+
+    if ((cache = poolCacheGet()) == NULL) return 0;
+    hash = poolCacheHash(key);
+    e = cache->entries + (hash % (POOL_CACHE_SLOTS / POOL_CACHE_WAYS)) * POOL_CACHE_WAYS;
+    for (i = 0; i < POOL_CACHE_WAYS; i++, e++)
+    {
+        unsigned int lock = e->lock;
+        int match;
+
+        if (lock & 1) continue; /* being written */
+        __sync_synchronize();
+        match = e->hash == hash && strncmp(e->key, key, sizeof(e->key)) == 0 &&
+            time(NULL) - e->created < POOL_CACHE_MAX_AGE;
+        if (match)
+        {
+            memcpy(value, &e->u, size);
+            *stamp = e->stamp;
+        }
+        __sync_synchronize();
+        if (e->lock != lock) continue; /* changed while reading */
+        if (match) return 1;
+    }
+    return 0;
+}
+
+static void poolCacheWrite(const char* key, const void* value, size_t size, unsigned long long stamp)
+{
+    poolCache* cache;
+    poolCacheEntry* e;
+    poolCacheEntry* oldest;
+    unsigned int hash;
+    unsigned int lock, generation;
+    int i;
+
+    if (stamp == 0) return;
+    if ((cache = poolCacheGet()) == NULL) return;
+    if (strlen(key) >= sizeof(e->key)) return;
+    hash = poolCacheHash(key);
+
+    /* use the entry with the same key or the oldest one */
+    e = oldest = cache->entries + (hash % (POOL_CACHE_SLOTS / POOL_CACHE_WAYS)) * POOL_CACHE_WAYS;
+    for (i = 0; i < POOL_CACHE_WAYS; i++, e++)
+    {
+        if (e->hash == hash && strcmp(e->key, key) == 0) break;
+        if (e->created < oldest->created) oldest = e;
+    }
+    if (i == POOL_CACHE_WAYS) e = oldest;
+
+    lock = e->lock;
+    if (lock & 1)
+    {
+        /* someone is writing, take over only if the writer has died */
+        pid_t writer = (pid_t)(lock >> 1);
+        if (kill(writer, 0) == 0 || errno != ESRCH) return;
+    }
+    if (!__sync_bool_compare_and_swap(&e->lock, lock, (unsigned int)getpid() << 1 | 1))
+        return; /* someone else was faster */
+
+    /* a new generation, even after a crashed writer, so readers notice the change */
+    generation = e->generation + 1;
+    e->generation = generation;
+    e->hash = hash;
+    e->created = (long)time(NULL);
+    e->stamp = stamp;
+    memcpy(&e->u, value, size);
+    strcpy(e->key, key);
+    __sync_synchronize();
+    e->lock = generation << 1;
+}
+
+static int poolCacheKey(char* key, size_t size, const char* moduledir, int len,
+    const char* version, int exactnessLevel)
+{
+    int n = snprintf(key, size, "%.*s\n%s\n%s\n%s\n%d",
+        len, moduledir, version ? version : "", epicsRelease, targetArch, exactnessLevel);
+    return n > 0 && (size_t)n < size;
+}
+
+/* moduledir is "<dirname>/<module>/" with length len */
+static int poolCacheLookup(const char* moduledir, int len, const char* version,
+    int exactnessLevel, poolCacheResult* result)
+{
+    char key[512];
+    unsigned long long stamp;
+    poolCacheResult r;
+
+    if (moduledir[0] != '/') return 0; /* only absolute directories are shared */
+    if (!poolCacheKey(key, sizeof(key), moduledir, len, version, exactnessLevel)) return 0;
+    if (!poolCacheRead(key, &r, sizeof(r), &stamp)) return 0;
+    r.found[sizeof(r.found)-1] = 0;
+    r.relevant[sizeof(r.relevant)-1] = 0;
+    if ((r.found[0] && !poolCacheValidName(r.found)) || strstr(r.relevant, ".."))
+    {
+        fprintf(stderr, "require: invalid pool cache entry for %.*s\n", len, moduledir);
+        return 0;
+    }
+    if (poolCacheStamp(moduledir, len, r.relevant) != stamp)
+    {
+        if (requireDebug)
+            printf("require: pool cache entry for %.*s is outdated\n", len, moduledir);
+        return 0;
+    }
+    *result = r;
+    if (requireDebug)
+        printf("require: pool cache hit for %.*s: \"%s\"\n", len, moduledir, r.found);
+    return 1;
+}
+
+/* remember a version that could change the result, call in order of the search */
+static void poolCacheRelevant(poolCacheResult* result, const char* version)
+{
+    size_t l = strlen(result->relevant);
+
+    if (l + strlen(version) + 2 > sizeof(result->relevant))
+        result->overflow = 1;
+    else
+        sprintf(result->relevant + l, "%s%s", l ? "/" : "", version);
+}
+
+static void poolCacheStore(const char* moduledir, int len, const char* version,
+    int exactnessLevel, poolCacheResult* result)
+{
+    char key[512];
+    char relevant[sizeof(result->relevant)];
+    char* v;
+    char* next;
+
+    if (moduledir[0] != '/' || result->overflow) return;
+    if (!poolCacheKey(key, sizeof(key), moduledir, len, version, exactnessLevel)) return;
+
+    /* versions lower than the found one cannot change the result */
+    strcpy(relevant, result->relevant);
+    result->relevant[0] = 0;
+    for (v = relevant; v && *v; v = next)
+    {
+        if ((next = strchr(v, '/')) != NULL) *next++ = 0;
+        if (!result->found[0] || strcmp(v, result->found) == 0 ||
+            compareVersions(v, result->found, exactnessLevel) == HIGHER)
+            poolCacheRelevant(result, v);
+    }
+    result->stamp = poolCacheStamp(moduledir, len, result->relevant);
+    poolCacheWrite(key, result, sizeof(*result), result->stamp);
+
+    if (requireDebug)
+        printf("require: pool cache store for %.*s: \"%s\" depending on \"%s\"\n",
+            len, moduledir, result->found, result->relevant);
+}
+
+/* listing of subdirectories of a module directory:
+   entries of type ('d' or '?' for unknown) and name, terminated by an empty entry */
+static int poolCacheListingLookup(const char* moduledir, char* listing)
+{
+    char key[512];
+    unsigned long long stamp;
+    char* p;
+
+    if (moduledir[0] != '/') return 0;
+    if (snprintf(key, sizeof(key), "%s\n", moduledir) >= (int)sizeof(key)) return 0;
+    if (!poolCacheRead(key, listing, POOL_CACHE_LISTING_SIZE, &stamp)) return 0;
+    listing[POOL_CACHE_LISTING_SIZE-1] = 0;
+    for (p = listing; *p; p += strlen(p) + 1)
+    {
+        if (!poolCacheValidName(p + 1))
+        {
+            fprintf(stderr, "require: invalid pool cache listing for %s\n", moduledir);
+            return 0;
+        }
+    }
+    if (poolCacheStamp(moduledir, (int)strlen(moduledir), NULL) != stamp) return 0;
+    if (requireDebug)
+        printf("require: pool cache listing of %s\n", moduledir);
+    return 1;
+}
+
+static void poolCacheListingStore(const char* moduledir, const char* listing, unsigned long long stamp)
+{
+    char key[512];
+
+    if (moduledir[0] != '/') return;
+    if (snprintf(key, sizeof(key), "%s\n", moduledir) >= (int)sizeof(key)) return;
+    poolCacheWrite(key, listing, POOL_CACHE_LISTING_SIZE, stamp);
+}
+
+#else
+#define poolCacheLookup(moduledir, len, version, exactnessLevel, result) 0
+#define poolCacheRelevant(result, version) ((void)(version))
+#define poolCacheStore(moduledir, len, version, exactnessLevel, result) ((void)(exactnessLevel))
+#endif
+
+/* driver path
+The existing directories of EPICS_DRIVER_PATH are found only once and
+again only if the variable or (for relative directories) the working
+directory has changed, or after requireRescan.
+On Linux, the directories are kept open. Module directories are opened
+and files below them are looked up relative to them (see fileBase).
+Thus a swapped symlink to the pool is followed only after requireRescan,
+but all files of a module come from the same pool.
+*/
+
+typedef struct driverDir
+{
+    const char* name;       /* not terminated, points into driverPath.value */
+    int len;
+    int fd;                 /* open directory or -1 */
+} driverDir;
+
+static struct
+{
+    char* value;
+    char* cwd;              /* NULL if all directories are absolute */
+    driverDir* dirs;
+    size_t count;
+} driverPath;
+
+/* requireRescan
+Find the directories of EPICS_DRIVER_PATH again with the next require,
+e.g. after a symlink to the module pool has been changed.
+*/
+int requireRescan(void)
+{
+    REQUIRE_LOCK_INIT();
+    REQUIRE_LOCK();
+    free(driverPath.value);
+    driverPath.value = NULL;
+    REQUIRE_UNLOCK();
+    return 0;
+}
+
+/* does value have relative directories, which depend on the working directory? */
+static int driverPathRelative(const char* value)
+{
+    const char* dirname;
+
+    for (dirname = value; dirname; dirname = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0]))
+    {
+        if (dirname != value) dirname++;
+        if (*dirname && *dirname != OSI_PATH_LIST_SEPARATOR[0] && *dirname != '/'
+#ifdef _WIN32
+            && !(isalpha((unsigned char)dirname[0]) && dirname[1] == ':')
+#endif
+            ) return 1;
+    }
+    return 0;
+}
+
+static driverDir* getDriverPath(const char* value, size_t* count)
+{
+    char cwd[PATH_MAX];
+    const char* dirname;
+    const char* end;
+    char* path;
+    size_t i, n;
+
+    cwd[0] = 0;
+    if (driverPath.value && strcmp(driverPath.value, value) == 0 &&
+        (!driverPath.cwd || (getcwd(cwd, sizeof(cwd)) && strcmp(driverPath.cwd, cwd) == 0)))
+    {
+        *count = driverPath.count;
+        return driverPath.dirs;
+    }
+
+#if defined (__linux)
+    for (i = 0; i < driverPath.count; i++)
+        if (driverPath.dirs[i].fd >= 0) close(driverPath.dirs[i].fd);
+#endif
+    free(driverPath.dirs);
+    free(driverPath.value);
+    free(driverPath.cwd);
+    driverPath.dirs = NULL;
+    driverPath.count = 0;
+    driverPath.value = strdup(value);
+    driverPath.cwd = NULL;
+    if (driverPathRelative(value) && (cwd[0] || getcwd(cwd, sizeof(cwd))))
+        driverPath.cwd = strdup(cwd);
+    if (!driverPath.value)
+    {
+        *count = 0;
+        return NULL;
+    }
+
+    for (n = 1, dirname = value; (dirname = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0])) != NULL; dirname++) n++;
+    driverPath.dirs = calloc(n, sizeof(driverDir));
+    if (!driverPath.dirs)
+    {
+        *count = 0;
+        return NULL;
+    }
+    for (dirname = driverPath.value; dirname != NULL; dirname = end)
+    {
+        driverDir* d = &driverPath.dirs[driverPath.count];
+
+        end = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0]);
+        if (end && end[1] == '/' && end[2] == '/')   /* "http://..." and friends */
+            end = strchr(end+2, OSI_PATH_LIST_SEPARATOR[0]);
+        if (end) d->len = (int)(end++ - dirname);
+        else d->len = (int)strlen(dirname);
+        if (d->len == 0) continue; /* ignore empty driverpath elements */
+        d->name = dirname;
+        d->fd = -1;
+        if (asprintf(&path, "%.*s/", d->len, dirname) < 0) continue;
+#if defined (__linux)
+        d->fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (d->fd < 0)
+        {
+            if (requireDebug)
+                printf("require: %s does not exist\n", path);
+            free(path);
+            continue; /* ignore non-existing driverpath elements */
+        }
+#else
+        if (!fileExists(path))
+        {
+            free(path);
+            continue; /* ignore non-existing driverpath elements */
         }
+#endif
+        free(path);
+        driverPath.count++;
     }
-    if (req_parts == 2)
+    *count = driverPath.count;
+    return driverPath.dirs;
+}
+
+#if !defined (_WIN32)
+/* a module directory, on Linux maybe listed from the pool cache */
+typedef struct moduleDir
+{
+    DIR* dir;               /* NULL if listed from the pool cache */
+#if defined (__linux)
+    char* path;             /* "<dirname>/<module>/" */
+    unsigned long long stamp;
+    struct dirent entry;    /* returned from the listing */
+    size_t pos;             /* fill level while reading dir, else read position */
+    int complete;           /* all entries read and fit into the listing */
+    char listing[POOL_CACHE_LISTING_SIZE];
+#endif
+} moduleDir;
+
+static moduleDir* openModuleDir(int dirfd, const char* module, const char* path)
+{
+    moduleDir* d = calloc(1, sizeof(moduleDir));
+
+    if (!d) return NULL;
+#if defined (__linux)
+    if (poolCacheGet() && (d->path = strdup(path)) != NULL)
     {
-        if (requireDebug)
-            printf("require: compareVersions: MATCH only major.minor number requested\n");
-        return MATCH;
+        if (poolCacheListingLookup(path, d->listing))
+            return d;
+        /* stamp before reading, a change while reading makes the listing outdated */
+        d->stamp = poolCacheStamp(path, (int)strlen(path), NULL);
+        d->listing[0] = 0;
     }
-    if (found_patch < req_patch)
+    if (dirfd >= 0)
     {
-        if (requireDebug)
-            printf("require: compareVersions: MISMATCH patch level too low\n");
-        return MISMATCH;
+        int fd = openat(dirfd, module, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+        if (fd >= 0 && (d->dir = fdopendir(fd)) == NULL) close(fd);
     }
-    if (found_patch == req_patch)
+    else
+#endif
+    d->dir = opendir(path);
+    if (!d->dir)
     {
-        if (requireDebug)
-            printf("require: compareVersions: MATCH patch level matches exactly requested\n");
-        return MATCH;
+#if defined (__linux)
+        free(d->path);
+#endif
+        free(d);
+        return NULL;
     }
-    if (req_extra[0] == '+' && exactnessLevel <= 1)
+    return d;
+}
+
+static struct dirent* readModuleDir(moduleDir* d)
+{
+    struct dirent* e;
+
+#if defined (__linux)
+    if (!d->dir)
     {
-        if (requireDebug)
-            printf("require: compareVersions: MATCH patch level higher than requested with +\n");
-        return MATCH;
+        char* p = d->listing + d->pos;
+        size_t l;
+
+        if (!*p) return NULL;
+        l = strlen(p);
+        d->entry.d_type = p[0] == 'd' ? DT_DIR : DT_UNKNOWN;
+        memcpy(d->entry.d_name, p + 1, l);
+        d->pos += l + 1;
+        return &d->entry;
     }
-    if (requireDebug)
-        printf("require: compareVersions: HIGHER patch level\n");
-    return HIGHER;
+#endif
+    e = readdir(d->dir);
+#if defined (__linux)
+    if (d->path)
+    {
+        if (!e)
+            d->complete = !errno && d->pos < POOL_CACHE_LISTING_SIZE;
+        else if (e->d_name[0] != '.' && (e->d_type == DT_DIR || e->d_type == DT_UNKNOWN))
+        {
+            /* keep d_type and name, and room for the terminating empty entry */
+            size_t l = strlen(e->d_name);
+            if (d->pos + l + 3 <= POOL_CACHE_LISTING_SIZE)
+            {
+                d->listing[d->pos] = e->d_type == DT_DIR ? 'd' : '?';
+                strcpy(d->listing + d->pos + 1, e->d_name);
+                d->pos += l + 2;
+                d->listing[d->pos] = 0;
+            }
+            else d->pos = POOL_CACHE_LISTING_SIZE;
+        }
+    }
+#endif
+    return e;
+}
+
+static void closeModuleDir(moduleDir* d)
+{
+    if (d->dir) closedir(d->dir);
+#if defined (__linux)
+    if (d->dir && d->complete)
+        poolCacheListingStore(d->path, d->listing, d->stamp);
+    free(d->path);
+#endif
+    free(d);
 }
+#endif
 
 /* require (module)
 Look if module is already loaded.
@@ -1177,6 +3621,31 @@ If require is called from the iocsh before iocInit and fails,
 it calls epicsExit to abort the application.
 */
 
+/* environment for the startup script, set by the first require (or requireDeferred) */
+static void requireSetupEnv(void)
+{
+    static int firstTime = 1;
+    char* cwd;
+
+    if (!firstTime) return;
+    firstTime = 0;
+    REQUIRE_LOCK_INIT();
+    cwd = malloc(PATH_MAX+1);
+    getcwd(cwd, PATH_MAX);
+#ifdef _WIN32
+    /* convert '\' to '/' */
+    char* p = cwd;
+    while ((p = strchr(p, '\\')) != NULL) *p = '/';
+#endif
+    putenvprintf("IOC_DIR=%s/", cwd);
+    putenvprintf("T_A=%s", targetArch);
+    putenvprintf("EPICS_HOST_ARCH=%s", targetArch);
+    putenvprintf("EPICS_RELEASE=%s", epicsRelease);
+    putenvprintf("EPICS_BASETYPE=%s", epicsBasetype);
+    putenvprintf("OS_CLASS=%s", osClass);
+    free(cwd);
+}
+
 /* wrapper to abort statup script */
 static int require_priv(const char* module, const char* version, const char* args, const char* versionstr);
 
@@ -1184,28 +3653,14 @@ int require(const char* module, const char* version, const char* args)
 {
     int status;
     char* versionstr;
-    static int firstTime = 1;
-
-    if (firstTime)
-    {
-        char* cwd;
+    statsModule* stats;
+    long heap;
+    const char* outerModule = probeModule;
+    const char* outerVersion = probeVersion;
+    const char* outerBase;
+    int outerBaseLen, outerBaseFd;
 
-        firstTime = 0;
-        cwd = malloc(PATH_MAX+1);
-        getcwd(cwd, PATH_MAX);
-#ifdef _WIN32
-        /* convert '\' to '/' */
-        char* p = cwd;
-        while ((p = strchr(p, '\\')) != NULL) *p = '/';
-#endif
-        putenvprintf("IOC_DIR=%s/", cwd);
-        putenvprintf("T_A=%s", targetArch);
-        putenvprintf("EPICS_HOST_ARCH=%s", targetArch);
-        putenvprintf("EPICS_RELEASE=%s", epicsRelease);
-        putenvprintf("EPICS_BASETYPE=%s", epicsBasetype);
-        putenvprintf("OS_CLASS=%s", osClass);
-        free(cwd);
-    }
+    requireSetupEnv();
 
     if (module == NULL)
     {
@@ -1257,13 +3712,38 @@ int require(const char* module, const char* version, const char* args)
     if (requireDebug)
         printf("require: versionstr = \"%s\"\n", versionstr);
 
+    REQUIRE_LOCK();
+    heap = heapStatsEnabled() ? heapUsed() : 0;
+    stats = statsEnter(module);
+    probeModule = module;
+    probeVersion = version ? version : "";
+    /* a dependency has its own file names */
+    outerBase = fileBase.path;
+    outerBaseLen = fileBase.len;
+    outerBaseFd = fileBase.fd;
+    fileBase.path = NULL;
     status = require_priv(module, version, args, versionstr);
+    fileBase.path = outerBase;
+    fileBase.len = outerBaseLen;
+    fileBase.fd = outerBaseFd;
+    probeModule = outerModule;
+    probeVersion = outerVersion;
+    /* count heap growth for this module only, not for the one requiring it */
+    if (heapStatsEnabled())
+    {
+        heap = heapUsed() - heap;
+        statsCurrent->heap += heap;
+        if (stats != &statsOther) stats->heap -= heap;
+    }
+    STATS_SET_CURRENT(stats);
+    localCacheEvict();
+    REQUIRE_UNLOCK();
 
     if (version) free(versionstr);
 
     if (status == 0) return 0;
     if (status != -1) perror("require");
-    if (interruptAccept) return status;
+    if (interruptAccept || deferredResolving) return status;
 
     /* require failed in startup script before iocInit */
     fprintf(stderr, "Aborting startup script\n");
@@ -1336,7 +3816,12 @@ static int require_priv(const char* module, const char* version, const char* arg
     int ifexists = 0;
     const char* driverpath;
     const char* dirname;
-    const char *end;
+    driverDir* driverdirs;
+    driverDir* founddriverdir = NULL;
+    size_t ndriverdirs, i;
+    int exactFound = 0;
+    int inBundle;
+    epicsTimeStamp searchStart;
 
     int releasediroffs;
     int libdiroffs = 0;
@@ -1344,6 +3829,7 @@ static int require_priv(const char* module, const char* version, const char* arg
     char* founddir = NULL;
     char* symbolname;
     char filename[PATH_MAX];
+    char localfile[PATH_MAX];
 
     int exactnessLevel = 0;
     int someVersionFound = 0;
@@ -1368,6 +3854,15 @@ static int require_priv(const char* module, const char* version, const char* arg
         (snprintf(filename + offs, sizeof(filename) - offs, __VA_ARGS__) && fileNotEmpty(filename))
 #endif
 
+    /* first existing file of a candidate list, see tryFiles */
+    #define TRY_CANDIDATES(nonempty, candidates) \
+        tryFiles(filename, sizeof(filename), releasediroffs, nonempty, \
+            candidates, sizeof(candidates)/sizeof(candidates[0]), (const char* const[]) \
+            { module, versionstr, targetArch, epicsRelease, epicsBasetype, osClass })
+    #define TRY_MODULE_DBD TRY_CANDIDATES(1, moduleDbdFiles)
+    #define TRY_STARTUP_SCRIPT TRY_CANDIDATES(0, startupScripts)
+
+
 #if defined (_WIN32)
     /* enable %n in printf */
     _set_printf_count_output(1);
@@ -1431,6 +3926,7 @@ static int require_priv(const char* module, const char* version, const char* arg
                 return -1;
             }
         }
+        if (deferredResolving || deferredActive) return 0;
         if (dirname[0] == 0) return 0;
         putenvprintf("MODULE=%s", module);
         pathAdd("SCRIPT_PATH", dirname);
@@ -1440,37 +3936,57 @@ static int require_priv(const char* module, const char* version, const char* arg
         if (requireDebug)
             printf("require: no %s version loaded yet\n", module);
 
-        /* Search for module in driverpath */
-        for (dirname = driverpath; dirname != NULL; dirname = end)
+        /* Search for module in (existing elements of) driverpath */
+        if (requireDebug)
+            epicsTimeGetCurrent(&searchStart);
+        REQUIRE_PROBE2(module_search_start, module, probeVersion);
+        driverdirs = getDriverPath(driverpath, &ndriverdirs);
+        for (i = 0; i < ndriverdirs && !exactFound; i++)
         {
             /* get one directory from driverpath */
-            int dirlen;
+            driverDir* driverdir = &driverdirs[i];
+            int dirlen = driverdir->len;
             int modulediroffs;
             DIR_HANDLE dir;
             DIR_ENTRY direntry;
+            poolCacheResult cached = { 0 };
+            int cacheable = !found && !someVersionFound;
+            int exactnessLevelBefore = exactnessLevel;
 
-            end = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0]);
-            if (end && end[1] == '/' && end[2] == '/')   /* "http://..." and friends */
-                end = strchr(end+2, OSI_PATH_LIST_SEPARATOR[0]);
-            if (end) dirlen = (int)(end++ - dirname);
-            else dirlen = (int)strlen(dirname);
-
-            if (dirlen == 0)
-                continue; /* ignore empty driverpath elements */
-
-            if (!TRY_FILE(0, "%.*s/", dirlen, dirname))
-                continue; /* ignore non-existing driverpath elements */
-
+            snprintf(filename, sizeof(filename), "%.*s/", dirlen, driverdir->name);
             dirlen += 1;
             /* filename = "<dirname>/[dirlen]" */
+            fileBase.path = filename;
+            fileBase.len = dirlen;
+            fileBase.fd = driverdir->fd;
 
             snprintf(filename+dirlen, sizeof(filename)-dirlen, "%s/%n", module, &modulediroffs);
             modulediroffs += dirlen;
             /* filename = "<dirname>/[dirlen]<module>/[modulediroffs]" */
 
+            /* Maybe an other IOC on this host has already searched this directory */
+            if (cacheable && poolCacheLookup(filename, modulediroffs, version, exactnessLevel, &cached))
+            {
+                exactnessLevel = cached.exactnessLevel;
+                someVersionFound = cached.someVersionFound;
+                someArchFound = cached.someArchFound;
+                if (cached.found[0])
+                {
+                    if (asprintf(&founddir, "%.*s%s", modulediroffs, filename, cached.found) < 0)
+                        return errno;
+                    /* founddir = "<dirname>/[dirlen]<module>/[modulediroffs]<version>" */
+                    found = founddir + modulediroffs;
+                    founddriverdir = driverdir;
+                    if (version && strcmp(found, version) == 0)
+                        exactFound = 1; /* exact match, we are done */
+                }
+                continue;
+            }
+
             /* Does the module directory exist? */
             IF_OPEN_DIR(filename)
             {
+                requireStatsAdd(REQUIRE_STAT_DIR_OPEN, 1);
                 if (TRY_FILE(modulediroffs, "use_exact_version")) exactnessLevel = 2;
                 else if (TRY_FILE(modulediroffs, "use_exact_minor_version")) exactnessLevel = 1;
 
@@ -1479,6 +3995,8 @@ static int require_priv(const char* module, const char* version, const char* arg
                 {
                     char* currentFilename = FILENAME(direntry);
 
+                    requireStatsAdd(REQUIRE_STAT_DIR_ENTRY, 1);
+
                     SKIP_NON_DIR(direntry)
                     if (currentFilename[0] == '.') continue;  /* ignore hidden directories */
 
@@ -1495,6 +4013,7 @@ static int require_priv(const char* module, const char* version, const char* arg
                         case MATCH: /* all given numbers match. */
                         {
                             someArchFound = 1;
+                            if (cacheable) poolCacheRelevant(&cached, currentFilename);
 
                             /* filename = "<dirname>/[dirlen]<module>/[modulediroffs]" */
                             /* Add our EPICS version */
@@ -1537,7 +4056,7 @@ static int require_priv(const char* module, const char* version, const char* arg
                                     printf("require: %s %s matches %s exactly\n",
                                         module, currentFilename, version);
                                 /* We are done. */
-                                end = NULL;
+                                exactFound = 1;
                                 break;
                             }
 
@@ -1570,9 +4089,18 @@ static int require_priv(const char* module, const char* version, const char* arg
                         return errno;
                     /* founddir = "<dirname>/[dirlen]<module>/[modulediroffs]<version>" */
                     found = founddir + modulediroffs; /* version part in the path */
+                    founddriverdir = driverdir;
                     if (status == EXACT) break;
                 }
                 END_DIR_LOOP
+                if (cacheable && (!found || strlen(found) < sizeof(cached.found)))
+                {
+                    cached.exactnessLevel = exactnessLevel;
+                    cached.someVersionFound = someVersionFound;
+                    cached.someArchFound = someArchFound;
+                    strcpy(cached.found, found ? found : "");
+                    poolCacheStore(filename, modulediroffs, version, exactnessLevelBefore, &cached);
+                }
             }
             else
             {
@@ -1608,7 +4136,7 @@ static int require_priv(const char* module, const char* version, const char* arg
                             printf("require: found old style %s\n", filename);
                         printf ("Module %s%s found in %.*s\n", module,
                             versionstr, dirlen, filename);
-                        goto loadlib;
+                        goto checkdeferred;
                     }
                 }
             }
@@ -1617,6 +4145,16 @@ static int require_priv(const char* module, const char* version, const char* arg
                 printf("require: no matching version in %.*s\n", dirlen, filename);
         }
 
+        REQUIRE_PROBE2(module_search_end, module, found ? found : "");
+        if (requireDebug)
+        {
+            epicsTimeStamp searchStop;
+            epicsTimeGetCurrent(&searchStop);
+            printf("require: searching %s%s in %lu driver path directories took %.3f ms\n",
+                module, versionstr, (unsigned long)ndriverdirs,
+                epicsTimeDiffInSeconds(&searchStop, &searchStart) * 1000);
+        }
+
         if (!found)
         {
             if (someArchFound)
@@ -1633,6 +4171,10 @@ static int require_priv(const char* module, const char* version, const char* arg
         }
 
         versionstr = "";
+        probeVersion = found;
+        /* names in filename start with founddir from now on */
+        fileBase.len = founddriverdir->len + 1;
+        fileBase.fd = founddriverdir->fd;
 
         /* founddir = "<dirname>/[dirlen]<module>/<version>" */
         printf ("Module %s version %s found in %s/\n", module, found, founddir);
@@ -1658,6 +4200,34 @@ checkdep:
                 return -1;
         }
 
+checkdeferred:
+        if (deferredResolving || deferredActive)
+        {
+            /* after iocInit we can neither load dbd files nor records nor run startup scripts */
+            char depfile[PATH_MAX];
+            const char* needs = NULL;
+
+            strcpy(depfile, filename);
+            if (TRY_MODULE_DBD) needs = "dbd file";
+            else if (TRY_STARTUP_SCRIPT) needs = "startup script";
+            if (needs)
+            {
+                fprintf(stderr, "Module %s has %s %s and cannot be required deferred\n",
+                    module, needs, filename);
+                return -1;
+            }
+            strcpy(filename, depfile);
+            if (deferredResolving)
+            {
+                /* reserve space in the module list records: name, version up to MAX_STRING_SIZE
+                   (a dependency of several deferred modules is counted more than once) */
+                deferredCount++;
+                deferredBufferSize += MAX_STRING_SIZE + 1;
+                if (strlen(module) + 1 > deferredNameLength) deferredNameLength = strlen(module) + 1;
+                return 0;
+            }
+        }
+
         if (!libdiroffs)
         {
             printf("Module %s is architecture independent\n", module);
@@ -1680,11 +4250,10 @@ checkdep:
             }
             else
             {
-loadlib:
                 /* filename = "<dirname>/[dirlen]<module>/<version>/R<epicsRelease>/[releasediroffs]/lib/<targetArch>/[libdiroffs]/PREFIX<module>INFIX[extoffs]EXT" */
                 /* or  (old)  "<dirname>/[dirlen][releasediroffs][libdiroffs]PREFIX<module>INFIX(-<version>)?[extoffs]EXT" */
                 printf("Loading library %s\n", filename);
-                if ((libhandle = loadlib(filename)) == NULL)
+                if ((libhandle = loadlib(localCacheFile(filename, localfile, sizeof(localfile)), module)) == NULL)
                     return -1;
 
                 /* now check what version we really got (with compiled-in version number) */
@@ -1694,6 +4263,7 @@ loadlib:
                 found = (const char*) getAddress(libhandle, symbolname);
                 free(symbolname);
                 printf("Loaded %s version %s\n", module, found);
+                if (found) probeVersion = found;
 
                 /* check what we got */
                 if (requireDebug)
@@ -1705,18 +4275,22 @@ loadlib:
                     return -1;
                 }
 
-                /* load dbd file */
-                if (TRY_NONEMPTY_FILE(releasediroffs, "dbd/%s%s.dbd", module, versionstr) ||
-                    TRY_NONEMPTY_FILE(releasediroffs, "%s%s.dbd", module, versionstr) ||
-                    TRY_NONEMPTY_FILE(releasediroffs, "../dbd/%s%s.dbd", module, versionstr) ||
-                    TRY_NONEMPTY_FILE(releasediroffs, "../%s%s.dbd", module, versionstr) ||
-                    TRY_NONEMPTY_FILE(releasediroffs, "../../dbd/%s.dbd", module)) /* org EPICSbase */
+                /* load dbd file, or use the dbd bundle if it has it */
+                if ((inBundle = dbdBundleLoad(module, found, filename, releasediroffs)) < 0)
+                    return -1;
+                if (inBundle || TRY_MODULE_DBD)
                 {
-                    printf("Loading dbd file %s\n", filename);
-                    if (dbLoadDatabase(filename, NULL, NULL) != 0)
+                    if (!inBundle)
                     {
-                        fprintf (stderr, "Error loading %s\n", filename);
-                        return -1;
+                        dbdBundleRecord(module, found, filename);
+                        printf("Loading dbd file %s\n", filename);
+                        REQUIRE_PROBE3(dbd_load_start, module, probeVersion, filename);
+                        if (dbLoadDatabase(localCacheFile(filename, localfile, sizeof(localfile)), NULL, NULL) != 0)
+                        {
+                            fprintf (stderr, "Error loading %s\n", filename);
+                            return -1;
+                        }
+                        REQUIRE_PROBE3(dbd_load_end, module, probeVersion, filename);
                     }
 
                     #ifndef EPICS_3_13
@@ -1725,17 +4299,41 @@ loadlib:
                         return errno;
 
                     printf ("Calling function %s\n", symbolname);
-                    #ifdef vxWorks
                     {
-                        FUNCPTR f = (FUNCPTR) getAddress(NULL, symbolname);
+                        epicsTimeStamp start, found, stop;
+                        int (*f)(struct dbBase*);
+
+                        epicsTimeGetCurrent(&start);
+                        /* call function directly instead of parsing an iocsh command */
+                        f = (int (*)(struct dbBase*)) getAddress(libhandle, symbolname);
+                        epicsTimeGetCurrent(&found);
                         if (f)
-                            f(pdbbase);
+                            status = f(pdbbase);
                         else
+                        #ifdef vxWorks
+                        {
                             fprintf (stderr, "require: can't find %s function\n", symbolname);
+                            status = -1;
+                        }
+                        #else /* !vxWorks */
+                            /* not exported? try iocsh */
+                            status = iocshCmd(symbolname);
+                        #endif /* !vxWorks */
+                        epicsTimeGetCurrent(&stop);
+                        /* the lookup is what the direct call changes, the registration itself takes the same time */
+                        if (requireDebug)
+                            printf("require: symbol lookup of %s %s in %.3f ms, %s took %.3f ms\n",
+                                symbolname, f ? "succeeded" : "failed",
+                                epicsTimeDiffInSeconds(&found, &start) * 1000,
+                                f ? "direct call" : "call via iocsh",
+                                epicsTimeDiffInSeconds(&stop, &found) * 1000);
+                    }
+                    if (status != 0)
+                    {
+                        fprintf (stderr, "require: calling %s failed\n", symbolname);
+                        free(symbolname);
+                        return -1;
                     }
-                    #else /* !vxWorks */
-                    iocshCmd(symbolname);
-                    #endif /* !vxWorks */
                     free(symbolname);
                     #endif /* !EPICS_3_13 */
                 }
@@ -1752,6 +4350,7 @@ loadlib:
     }
 
     status = 0;
+    if (deferredActive) return 0; /* neither environment nor startup script */
 
     if (requireDebug)
         printf("require: looking for template directory\n");
@@ -1772,43 +4371,7 @@ loadlib:
     if (requireDebug)
         printf("require: looking for startup script\n");
     /* filename = "<dirname>/<module>/<version>/R<epicsRelease>/[releasediroffs]db" */
-    if (TRY_FILE(releasediroffs, "%s-%s.iocsh", targetArch, epicsRelease) ||
-        TRY_FILE(releasediroffs, "../" "%s-%s.iocsh", targetArch, epicsRelease) ||
-        TRY_FILE(releasediroffs, "%s-%s.cmd", targetArch, epicsRelease) ||
-        TRY_FILE(releasediroffs, "../%s-%s.cmd", targetArch, epicsRelease) ||
-        TRY_FILE(releasediroffs, "%s-%s.iocsh", targetArch, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "../%s-%s.iocsh", targetArch, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "%s-%s.cmd", targetArch, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "../%s-%s.cmd", targetArch, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "%s-%s.iocsh", osClass, epicsRelease) ||
-        TRY_FILE(releasediroffs, "../%s-%s.iocsh", osClass, epicsRelease) ||
-        TRY_FILE(releasediroffs, "%s-%s.cmd", osClass, epicsRelease) ||
-        TRY_FILE(releasediroffs, "../%s-%s.cmd", osClass, epicsRelease) ||
-        TRY_FILE(releasediroffs, "%s-%s.iocsh", osClass, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "../%s-%s.iocsh", osClass, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "%s-%s.cmd", osClass, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "../%s-%s.cmd", osClass, epicsBasetype) ||
-        TRY_FILE(releasediroffs, "startup-%s.iocsh", epicsRelease) ||
-        TRY_FILE(releasediroffs, "../startup-%s.iocsh", epicsRelease) ||
-        TRY_FILE(releasediroffs, "startup-%s.cmd", epicsRelease) ||
-        TRY_FILE(releasediroffs, "../startup-%s.cmd", epicsRelease) ||
-        TRY_FILE(releasediroffs, "startup-%s.iocsh", epicsBasetype) ||
-        TRY_FILE(releasediroffs, "../startup-%s.iocsh", epicsBasetype) ||
-        TRY_FILE(releasediroffs, "startup-%s.cmd", epicsBasetype) ||
-        TRY_FILE(releasediroffs, "../startup-%s.cmd", epicsBasetype) ||
-        TRY_FILE(releasediroffs, "%s.iocsh", targetArch) ||
-        TRY_FILE(releasediroffs, "../%s.iocsh", targetArch) ||
-        TRY_FILE(releasediroffs, "%s.cmd", targetArch) ||
-        TRY_FILE(releasediroffs, "../%s.cmd", targetArch) ||
-        TRY_FILE(releasediroffs, "%s.iocsh", osClass) ||
-        TRY_FILE(releasediroffs, "../%s.iocsh", osClass) ||
-        TRY_FILE(releasediroffs, "%s.cmd", osClass) ||
-        TRY_FILE(releasediroffs, "../%s.cmd", osClass) ||
-        TRY_FILE(releasediroffs, "startup.iocsh") ||
-        TRY_FILE(releasediroffs, "../startup.iocsh") ||
-        TRY_FILE(releasediroffs, "startup.cmd") ||
-        TRY_FILE(releasediroffs, "../startup.cmd")
-        )
+    if (TRY_STARTUP_SCRIPT)
     {
         if (args)
             printf("Executing %s with \"%s\"\n", filename, args);
@@ -1819,14 +4382,367 @@ loadlib:
         }
         else
             printf("Executing %s\n", filename);
-        if (runScript(filename, args) != 0)
+        REQUIRE_PROBE3(snippet_start, module, probeVersion, filename);
+        if (runScript(localCacheFile(filename, localfile, sizeof(localfile)), args) != 0)
             fprintf (stderr, "Error executing %s\n", filename);
         else
             printf("Done with %s\n", filename);
+        REQUIRE_PROBE3(snippet_end, module, probeVersion, filename);
     }
     return status;
 }
 
+#ifndef EPICS_3_13
+/* requireDeferred "<module>" [, "<version>"]
+Require a module in a background thread after iocInit, so that it does not
+delay the IOC coming online. Only modules (and dependencies) without dbd
+file and without startup script can be deferred, because neither can be
+loaded after iocInit. Before iocInit, the module and its dependencies are
+looked up without loading anything, so that such a module is refused right
+away and the module list records reserve space for all of them. They are
+updated when all deferred modules have been loaded.
+The deferred thread sets neither environment variables (<module>_VERSION,
+<module>_DIR, TEMPLATES, ...) nor SCRIPT_PATH, because the shell may read
+them at the same time.
+*/
+static int deferredThreadRunning = 0;
+
+static void updateModuleListRecords(void)
+{
+    static const struct { const char* name; short type; } records[] = {
+        { ":MODULES", DBF_STRING }, { ":VERSIONS", DBF_STRING }, { ":MOD_VER", DBF_CHAR } };
+    DBADDR addr[3];
+    int found[3];
+    int i;
+
+    REQUIRE_LOCK();
+    for (i = 0; i < 3; i++)
+    {
+        found[i] = (getRecordHandle(records[i].name, records[i].type, 0, &addr[i]) == 0);
+        if (found[i]) dbScanLock(addr[i].precord);
+    }
+    fillModuleListRecord(initHookAfterFinishDevSup);
+    for (i = 0; i < 3; i++)
+    {
+        if (!found[i]) continue;
+        dbProcess(addr[i].precord);
+        dbScanUnlock(addr[i].precord);
+    }
+    REQUIRE_UNLOCK();
+}
+
+static void deferredThread(void* arg)
+{
+    deferredModule* d;
+
+    while (1)
+    {
+        REQUIRE_LOCK();
+        if ((d = deferredModules) == NULL)
+        {
+            deferredThreadRunning = 0;
+            REQUIRE_UNLOCK();
+            break;
+        }
+        deferredModules = d->next;
+        deferredActive = 1;
+        printf("Deferred require %s%s%s\n", d->name, d->version ? " " : "", d->version ? d->version : "");
+        if (require(d->name, d->version, NULL) != 0)
+            fprintf(stderr, "Deferred require %s failed\n", d->name);
+        deferredActive = 0;
+        REQUIRE_UNLOCK();
+        free(d);
+    }
+    updateModuleListRecords();
+}
+
+/* called with requireLock held */
+static void deferredStart(void)
+{
+    if (deferredThreadRunning || !deferredModules) return;
+    deferredThreadRunning = 1;
+    epicsThreadCreate("requireDeferred", epicsThreadPriorityLow,
+        epicsThreadGetStackSize(epicsThreadStackBig), deferredThread, NULL);
+}
+
+static void deferredInitHook(initHookState state)
+{
+    if (state != initHookAfterInterruptAccept) return;
+    REQUIRE_LOCK();
+    deferredStart();
+    REQUIRE_UNLOCK();
+}
+
+int requireDeferred(const char* module, const char* version)
+{
+    deferredModule *d, **pd;
+    int status;
+    static int firstTime = 1;
+
+    if (module == NULL)
+    {
+        printf("Usage: requireDeferred \"<module>\" [, \"<version>\"]\n");
+        printf("Requires the module in the background after iocInit.\n");
+        printf("Only for modules without dbd file and startup script snippet.\n");
+        return -1;
+    }
+    if (version && version[0] == 0) version = NULL;
+
+    d = calloc(1, sizeof(deferredModule) + strlen(module) + (version ? strlen(version) + 1 : 0));
+    if (d == NULL)
+    {
+        fprintf(stderr, "require: out of memory\n");
+        return -1;
+    }
+    strcpy(d->name, module);
+    if (version) d->version = strcpy(d->name + strlen(module) + 1, version);
+
+    requireSetupEnv(); /* here, not in the deferred thread */
+    REQUIRE_LOCK_INIT();
+    REQUIRE_LOCK();
+    if (!interruptAccept)
+    {
+        /* check and count the module and its dependencies */
+        deferredResolving = 1;
+        status = require(module, version, NULL);
+        deferredResolving = 0;
+        if (status != 0)
+        {
+            fprintf(stderr, "Cannot defer require %s\n", module);
+            REQUIRE_UNLOCK();
+            free(d);
+            return -1;
+        }
+    }
+    for (pd = &deferredModules; *pd; pd = &(*pd)->next);
+    *pd = d;
+    if (interruptAccept)
+    {
+        deferredStart();
+    }
+    else
+    {
+        printf("Deferring require %s until after iocInit\n", module);
+        if (firstTime)
+        {
+            initHookRegister(deferredInitHook);
+            firstTime = 0;
+        }
+        /* resize the module list records in case no more modules will be required */
+        if (MODULE_NEXT(loadedModules) && !getenv("REQUIRE_FORK_SERVER"))
+        {
+            moduleitem* m;
+            size_t lm, lv, ll, lo;
+
+            for (m = MODULE_NEXT(loadedModules); MODULE_NEXT(m->next); m = MODULE_NEXT(m->next));
+            lm = strlen(m->content)+1;
+            lv = strlen(m->content+lm)+1;
+            ll = strlen(m->content+lm+lv)+1;
+            lo = strlen(m->content+lm+lv+ll)+1;
+            loadModuleRecords(m->content, m->content+lm, lo > 1 ? (long)lo : 0);
+        }
+    }
+    REQUIRE_UNLOCK();
+    return 0;
+}
+#endif
+
+#if defined (__linux) && !defined (EPICS_3_13)
+/* requireForkServer (fifo)
+Linux only: Keep all modules required so far loaded and fork a new IOC
+for each request read from the fifo. The forked IOC runs its own startup
+script and inherits the module registry, thus require finds the already
+loaded modules with the usual version check.
+A request is one line of tab separated fields:
+<directory> <startup script> <console> <reply fifo> [<variable>=<value> ...]
+The pid of the forked IOC is written to the reply fifo.
+
+Module records are not loaded in the fork server but in each forked IOC
+because they depend on the IOC name.
+Anyone who can write to the fifo can run commands as this user, so the fifo
+must belong to the user and must not be accessible by anyone else.
+A forked process has only the thread that called fork. Other threads are
+missing in the forked IOC, and locks they held stay locked forever.
+Thus the fork server refuses to start when any other thread runs already,
+be it one of a module (e.g. started by configuring a driver) or one of
+EPICS base (e.g. errlog, which starts with the first error message).
+*/
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <epicsThread.h>
+
+/* number of threads of this process, names of the other threads in names */
+static int threadCount(char* names, size_t size)
+{
+    DIR* dir = opendir("/proc/self/task");
+    struct dirent* entry;
+    int n = 0;
+    size_t len = 0;
+
+    names[0] = 0;
+    if (!dir) return -1;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        char commname[300];
+        char comm[32];
+        FILE* file;
+
+        if (entry->d_name[0] == '.') continue;
+        n++;
+        if (atoi(entry->d_name) == getpid()) continue;
+        snprintf(commname, sizeof(commname), "/proc/self/task/%s/comm", entry->d_name);
+        if ((file = fopen(commname, "r")) == NULL) continue;
+        if (fgets(comm, sizeof(comm), file) && len < size)
+        {
+            comm[strcspn(comm, "\n")] = 0;
+            len += snprintf(names + len, size - len, "%s%s", len ? ", " : "", comm);
+        }
+        fclose(file);
+    }
+    closedir(dir);
+    return n;
+}
+
+static void forkedIoc(char* dirname, const char* script, const char* console, char** vars)
+{
+    moduleitem* m;
+    int fd;
+
+    setsid();
+    signal(SIGCHLD, SIG_DFL);
+    fd = open(console, O_RDWR|O_NOCTTY);
+    if (fd < 0)
+        perror(console);
+    else
+    {
+        dup2(fd, 0);
+        dup2(fd, 1);
+        dup2(fd, 2);
+        if (fd > 2) close(fd);
+    }
+    if (chdir(dirname) != 0)
+        perror(dirname);
+    unsetenv("REQUIRE_FORK_SERVER");
+    putenvprintf("IOC_DIR=%s/", dirname);
+    for (; *vars; vars++)
+        putenvprintf("%s", *vars);
+
+    /* now load the records of the modules inherited from the fork server */
+    for (m = MODULE_NEXT(loadedModules); m; m = MODULE_NEXT(m->next))
+    {
+        size_t lm = strlen(m->content)+1;
+        size_t lv = strlen(m->content+lm)+1;
+        size_t ll = strlen(m->content+lm+lv)+1;
+        size_t lo = strlen(m->content+lm+lv+ll);
+        loadModuleRecords(m->content, m->content+lm, lo ? (long)lo+1 : 0);
+    }
+
+    /* continue like softIoc main() */
+    iocsh(script);
+    epicsThreadSleep(.2);
+    iocsh(NULL);
+    epicsExit(0);
+}
+
+static void requireForkServer(const char* fifoname)
+{
+    FILE* fifo;
+    char line[4096];
+    struct stat filestat;
+    int fd;
+
+    if (!fifoname) fifoname = getenv("REQUIRE_FORK_SERVER");
+    if (!fifoname)
+    {
+        fprintf(stderr, "usage: requireForkServer \"fifo\"\n");
+        return;
+    }
+    if (interruptAccept)
+    {
+        fprintf(stderr, "requireForkServer: not possible after iocInit\n");
+        return;
+    }
+    if (threadCount(line, sizeof(line)) != 1)
+    {
+        fprintf(stderr, "requireForkServer: not possible with other threads running: %s\n",
+            line[0] ? line : "(cannot read /proc/self/task)");
+        return;
+    }
+    if (mkfifo(fifoname, 0600) != 0 && errno != EEXIST)
+    {
+        perror(fifoname);
+        return;
+    }
+    /* open for read and write to stay open when clients close */
+    if ((fd = open(fifoname, O_RDWR|O_NOFOLLOW|O_CLOEXEC)) < 0)
+    {
+        perror(fifoname);
+        return;
+    }
+    /* an existing fifo may have been planted by someone else */
+    if (fstat(fd, &filestat) != 0 || !S_ISFIFO(filestat.st_mode) ||
+        filestat.st_uid != geteuid() || (filestat.st_mode & 077) != 0)
+    {
+        fprintf(stderr, "requireForkServer: %s must be a fifo of user %d with mode 0600\n",
+            fifoname, (int)geteuid());
+        close(fd);
+        return;
+    }
+    if ((fifo = fdopen(fd, "r+")) == NULL)
+    {
+        perror(fifoname);
+        close(fd);
+        return;
+    }
+    signal(SIGCHLD, SIG_IGN); /* no zombies */
+    printf("Waiting for IOC requests on %s\n", fifoname);
+    while (fgets(line, sizeof(line), fifo))
+    {
+        char* fields[64];
+        char* p = line;
+        int n = 0;
+        pid_t pid;
+
+        line[strcspn(line, "\n")] = 0;
+        while (p && n < 63)
+        {
+            fields[n++] = p;
+            if ((p = strchr(p, '\t')) != NULL) *p++ = 0;
+        }
+        fields[n] = NULL;
+        if (n < 4)
+        {
+            fprintf(stderr, "requireForkServer: invalid request \"%s\"\n", line);
+            continue;
+        }
+        fflush(NULL);
+        pid = fork();
+        if (pid == 0)
+        {
+            fclose(fifo);
+            forkedIoc(fields[0], fields[1], fields[2], fields+4);
+        }
+        if (pid < 0)
+            perror("requireForkServer: fork failed");
+        else
+            printf("Started IOC %d in %s with %s\n", (int)pid, fields[0], fields[1]);
+        {
+            /* do not block if the client is gone */
+            int fd = open(fields[3], O_WRONLY|O_NONBLOCK);
+            if (fd >= 0)
+            {
+                char reply[20];
+                if (write(fd, reply, sprintf(reply, "%d\n", (int)pid)) < 0)
+                    perror(fields[3]);
+                close(fd);
+            }
+        }
+    }
+    fclose(fifo);
+}
+#endif
+
 #ifndef EPICS_3_13
 static const iocshFuncDef requireDef = {
     "require", 3, (const iocshArg *[]) {
@@ -1840,6 +4756,17 @@ static void requireFunc (const iocshArgBuf *args)
     require(args[0].sval, args[1].sval, args[2].sval);
 }
 
+static const iocshFuncDef requireDeferredDef = {
+    "requireDeferred", 2, (const iocshArg *[]) {
+        &(iocshArg) { "module", iocshArgString },
+        &(iocshArg) { "[version]", iocshArgString },
+}};
+
+static void requireDeferredFunc (const iocshArgBuf *args)
+{
+    requireDeferred(args[0].sval, args[1].sval);
+}
+
 static const iocshFuncDef libversionShowDef = {
     "libversionShow", 1, (const iocshArg *[]) {
         &(iocshArg) { "outputfile", iocshArgString },
@@ -1857,7 +4784,7 @@ static const iocshFuncDef ldDef = {
 
 static void ldFunc (const iocshArgBuf *args)
 {
-    loadlib(args[0].sval);
+    loadlib(args[0].sval, NULL);
 }
 
 static const iocshFuncDef pathAddDef = {
@@ -1871,16 +4798,68 @@ static void pathAddFunc (const iocshArgBuf *args)
     pathAdd(args[0].sval, args[1].sval);
 }
 
+static const iocshFuncDef requireRescanDef = {
+    "requireRescan", 0, NULL
+};
+
+static void requireRescanFunc (const iocshArgBuf *args)
+{
+    requireRescan();
+}
+
+static const iocshFuncDef requireStatsDef = {
+    "requireStats", 1, (const iocshArg *[]) {
+        &(iocshArg) { "[module]", iocshArgString },
+}};
+
+static void requireStatsFunc (const iocshArgBuf *args)
+{
+    requireStats(args[0].sval);
+}
+
+#if defined (__linux)
+static const iocshFuncDef requireMemShowDef = {
+    "requireMemShow", 1, (const iocshArg *[]) {
+        &(iocshArg) { "[module]", iocshArgString },
+}};
+
+static void requireMemShowFunc (const iocshArgBuf *args)
+{
+    requireMemShow(args[0].sval);
+}
+
+static const iocshFuncDef requireForkServerDef = {
+    "requireForkServer", 1, (const iocshArg *[]) {
+        &(iocshArg) { "fifo", iocshArgString },
+}};
+
+static void requireForkServerFunc (const iocshArgBuf *args)
+{
+    requireForkServer(args[0].sval);
+}
+#endif
+
 static void requireRegister(void)
 {
     static int firstTime = 1;
     if (firstTime) {
         firstTime = 0;
         iocshRegister (&requireDef, requireFunc);
+        iocshRegister (&requireDeferredDef, requireDeferredFunc);
         iocshRegister (&libversionShowDef, libversionShowFunc);
         iocshRegister (&ldDef, ldFunc);
         iocshRegister (&pathAddDef, pathAddFunc);
+        iocshRegister (&requireRescanDef, requireRescanFunc);
+        iocshRegister (&requireStatsDef, requireStatsFunc);
+#if defined (__linux)
+        iocshRegister (&requireMemShowDef, requireMemShowFunc);
+        iocshRegister (&requireForkServerDef, requireForkServerFunc);
+#endif
+        /* same lock order as require(): requireLock before the loader lock */
+        REQUIRE_LOCK_INIT();
+        REQUIRE_LOCK();
         registerExternalModules();
+        REQUIRE_UNLOCK();
     }
 }
 
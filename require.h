@@ -12,6 +12,8 @@ extern "C" {
 #endif
 
 epicsShareFunc int require(const char* libname, const char* version, const char* args);
+epicsShareFunc int requireDeferred(const char* libname, const char* version);
+epicsShareFunc int requireRescan(void);
 epicsShareFunc size_t foreachLoadedLib(size_t (*func)(const char* name, const char* version, const char* path, void* arg), void* arg);
 epicsShareFunc const char* getLibVersion(const char* libname);
 epicsShareFunc const char* getLibLocation(const char* libname);
@@ -19,6 +21,24 @@ epicsShareFunc int libversionShow(const char* outfile);
 epicsShareFunc int runScript(const char* filename, const char* args);
 epicsShareFunc int putenvprintf(const char* format, ...) __attribute__((__format__(__printf__,1,2)));
 epicsShareFunc void pathAdd(const char* varname, const char* dirname);
+epicsShareFunc size_t foreachPathDir(const char* varname, size_t (*func)(const char* dirname, size_t len, void* arg), void* arg);
+
+/* counters shown by requireStats */
+enum {
+    REQUIRE_STAT_HIT,       /* stat of an existing file */
+    REQUIRE_STAT_MISS,      /* stat of a non-existing file */
+    REQUIRE_STAT_DIR_OPEN,
+    REQUIRE_STAT_DIR_ENTRY,
+    REQUIRE_STAT_FOPEN,     /* fopen attempts in path searches */
+    REQUIRE_STAT_BYTES,
+    REQUIRE_STAT_DLOPEN,
+    REQUIRE_STAT_PUTENV,
+    REQUIRE_STAT_COUNT
+};
+epicsShareFunc void requireStatsAdd(int counter, size_t n);
+epicsShareFunc int requireStats(const char* module);
+/* library RSS/PSS and heap per module, fails on other systems than Linux */
+epicsShareFunc int requireMemShow(const char* module);
 
 #ifdef __cplusplus
 }
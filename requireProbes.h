@@ -0,0 +1,68 @@
+#ifndef requireProbes_h
+#define requireProbes_h
+
+/* Static trace points (USDT) for bpftrace, perf or systemtap.
+ * They compile to a single nop and cost nothing while nobody traces.
+ * Without <sys/sdt.h> or with REQUIRE_NO_PROBES defined they are left out.
+ * All probes are in provider "require" and get the module name and
+ * version as their first two arguments. See App/tools/require*.bt for examples.
+ */
+
+#if defined(__linux) && !defined(REQUIRE_NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+#define REQUIRE_PROBES
+#endif
+#endif
+
+#ifdef REQUIRE_PROBES
+/* Every probe has a semaphore, which tracers increment while attached.
+ * They are defined in require.c. Add new probes here.
+ */
+#define REQUIRE_PROBE_NAMES(X) \
+    X(module_search_start) X(module_search_end) \
+    X(dlopen_start) X(dlopen_end) \
+    X(dbd_load_start) X(dbd_load_end) \
+    X(snippet_start) X(snippet_end) \
+    X(script_line_start) X(script_line_end) \
+    X(template_row_start) X(template_row_end)
+
+#define REQUIRE_PROBE_SEMAPHORE(name) \
+    __extension__ extern unsigned short require_##name##_semaphore \
+    __attribute__ ((unused)) __attribute__ ((section (".probes")));
+REQUIRE_PROBE_NAMES(REQUIRE_PROBE_SEMAPHORE)
+
+#define REQUIRE_PROBE_ENABLED(name) __builtin_expect(require_##name##_semaphore, 0)
+
+#define REQUIRE_PROBE2(name, module, version) \
+    DTRACE_PROBE2(require, name, module, version)
+#define REQUIRE_PROBE3(name, module, version, arg) \
+    DTRACE_PROBE3(require, name, module, version, arg)
+/* for code outside of require() that runs on behalf of the current module,
+ * which is looked up only while the probe is traced
+ */
+#define REQUIRE_PROBE_CONTEXT(name, arg) do { \
+    if (REQUIRE_PROBE_ENABLED(name)) { \
+        const char *module_, *version_; \
+        requireProbeContext(&module_, &version_); \
+        DTRACE_PROBE3(require, name, module_, version_, arg); \
+    }} while (0)
+#else
+#define REQUIRE_PROBE2(name, module, version)
+#define REQUIRE_PROBE3(name, module, version, arg)
+#define REQUIRE_PROBE_CONTEXT(name, arg)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* module and version currently being required by this thread, or "" outside of require */
+void requireProbeContext(const char** module, const char** version);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -13,6 +13,8 @@
 
 #define EPICSVER EPICS_VERSION*10000+EPICS_REVISION*100+EPICS_MODIFICATION
 
+#define MAX_EXPRESSION_SIZE (1<<20)
+
 #ifdef vxWorks
 #include "asprintf.h"
 #ifdef _WRS_VXWORKS_MAJOR
@@ -45,6 +47,7 @@ epicsShareFunc int epicsShareAPI iocshCmd(const char *cmd);
 
 #include "expr.h"
 #include "require.h"
+#include "requireProbes.h"
 
 #define SAVEENV(var) do { old_##var = getenv(#var); if (old_##var) old_##var=strdup(old_##var); } while(0)
 #define RESTOREENV(var) do { if(old_##var) { putenvprintf("%s=%s", #var, old_##var); free(old_##var); }} while(0)
@@ -69,6 +72,28 @@ int isAbsPath(const char* filename)
 #endif
 }
 
+struct openInDirArgs {
+    const char* filename;
+    FILE* file;
+};
+
+static size_t openInDir(const char* dirname, size_t dirlen, void* arg)
+{
+    struct openInDirArgs* a = arg;
+    char* fullname;
+
+    if (dirname[dirlen-1] == '/') dirlen--;
+    if (asprintf(&fullname, "%.*s/%s",
+        (int)dirlen, dirname, a->filename) < 0) return 0;
+    if (runScriptDebug)
+        printf("runScript: trying %s\n", fullname);
+    requireStatsAdd(REQUIRE_STAT_FOPEN, 1);
+    a->file = fopen(fullname, "r");
+    if (!a->file && (errno & 0xffff) != ENOENT) perror(fullname);
+    free(fullname);
+    return a->file != NULL;
+}
+
 int runScript(const char* filename, const char* args)
 {
     MAC_HANDLE *mac = NULL;
@@ -163,34 +188,14 @@ int runScript(const char* filename, const char* args)
 
     if (isAbsPath(filename))
     {
+        requireStatsAdd(REQUIRE_STAT_FOPEN, 1);
         file = fopen(filename, "r");
     }
     else
     {
-        const char* dirname;
-        const char* end;
-        char* fullname;
-        const char* path = getenv("SCRIPT_PATH");
-        int dirlen;
-
-        for (dirname = path; dirname != NULL; dirname = end)
-        {
-            end = strchr(dirname, OSI_PATH_LIST_SEPARATOR[0]);
-            if (end && end[1] == '/' && end[2] == '/')   /* "http://..." and friends */
-                end = strchr(end+2, OSI_PATH_LIST_SEPARATOR[0]);
-            if (end) dirlen = (int)(end++ - dirname);
-            else dirlen = (int)strlen(dirname);
-            if (dirlen == 0) continue; /* ignore empty path elements */
-            if (dirname[dirlen-1] == '/') dirlen--;
-            asprintf(&fullname, "%.*s/%s",
-                dirlen, dirname, filename);
-            if (runScriptDebug)
-                printf("runScript: trying %s\n", fullname);
-            file = fopen(fullname, "r");
-            if (!file && (errno & 0xffff) != ENOENT) perror(fullname);
-            free(fullname);
-            if (file) break;
-        }
+        struct openInDirArgs a = { filename, NULL };
+        foreachPathDir("SCRIPT_PATH", openInDir, &a);
+        file = a.file;
     }
     if (file == NULL) { perror(filename); return errno; }
 
@@ -211,6 +216,7 @@ int runScript(const char* filename, const char* args)
             if ((line_raw = realloc(line_raw, line_raw_size *= 2)) == NULL) goto error;
             if (fgets(line_raw + len, line_raw_size - len, file) == NULL) break;
         }
+        requireStatsAdd(REQUIRE_STAT_BYTES, len);
         while (len > 0 && isspace((unsigned char)line_raw[len-1])) line_raw[--len] = 0; /* get rid of '\n' and friends */
 
         /* Remember state of macros in case environment variable gets expanded */
@@ -248,7 +254,20 @@ int runScript(const char* filename, const char* args)
         if ((x = strpbrk(p, "=(, \t\n\r")) != NULL && *x=='=')
         {
             *x++ = 0;
-            replaceExpressions(x, line_raw, line_raw_size);
+            while (replaceExpressions(x, line_raw, line_raw_size) >= (size_t)line_raw_size)
+            {
+                /* e.g. a format with a huge width would grow the buffer until memory is exhausted */
+                if (line_raw_size >= MAX_EXPRESSION_SIZE)
+                {
+                    fprintf(stderr, "runScript: Value of %s too long (>=%d)\n", p, MAX_EXPRESSION_SIZE);
+                    status = -1;
+                    goto end;
+                }
+                if (runScriptDebug)
+                    printf("runScript: grow expression buffer: size=%ld\n", line_raw_size);
+                free(line_raw);
+                if ((line_raw = malloc(line_raw_size *= 2)) == NULL) goto error;
+            }
             if (runScriptDebug)
                 printf("runScript: assign %s=%s\n", p, line_raw);
             macPutValue(mac, p, line_raw);
@@ -275,7 +294,9 @@ int runScript(const char* filename, const char* args)
 #else
         if (runScriptDebug)
             printf("runScript: iocshCmd: '%s'\n", line_exp);
+        REQUIRE_PROBE_CONTEXT(script_line_start, line_exp);
         status = iocshCmd(line_exp);
+        REQUIRE_PROBE_CONTEXT(script_line_end, line_exp);
 #endif
         if (status != 0) break;
     }
@@ -0,0 +1,138 @@
+/*
+* Benchmark of require: resolve and load modules from a (synthetic) pool.
+*
+*   benchRequire [-c] <pool> <module> ...
+*
+* Requires each module with EPICS_DRIVER_PATH=<pool> and prints the time
+* it took. With -c, it runs the same in a child process traced with ptrace
+* and prints the number of system calls instead, in total and for stat,
+* open and directory reading. Everything require prints goes to /dev/null.
+*/
+
+#include "../require.c"
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+static int requireAll(int n, char** modules)
+{
+    int i;
+
+    for (i = 0; i < n; i++)
+        if (require(modules[i], NULL, NULL) != 0)
+            return -1;
+    return 0;
+}
+
+enum { STAT, OPEN, DIRREAD, TOTAL, COUNTERS };
+static const char* const counterNames[COUNTERS] = { "stat", "open", "getdents", "total" };
+
+static int syscallCategory(long nr)
+{
+    switch (nr)
+    {
+#ifdef __NR_stat
+        case __NR_stat:
+#endif
+#ifdef __NR_lstat
+        case __NR_lstat:
+#endif
+#ifdef __NR_access
+        case __NR_access:
+#endif
+#ifdef __NR_faccessat2
+        case __NR_faccessat2:
+#endif
+#ifdef __NR_statx
+        case __NR_statx:
+#endif
+        case __NR_newfstatat:
+        case __NR_faccessat:
+            return STAT;
+#ifdef __NR_open
+        case __NR_open:
+#endif
+#ifdef __NR_openat2
+        case __NR_openat2:
+#endif
+        case __NR_openat:
+            return OPEN;
+        case __NR_getdents64:
+            return DIRREAD;
+    }
+    return -1;
+}
+
+/* run requireAll in a traced child and count its system calls */
+static int countSyscalls(int n, char** modules, unsigned long counters[COUNTERS])
+{
+    struct __ptrace_syscall_info info;
+    pid_t pid;
+    int status;
+
+    fflush(NULL);
+    if ((pid = fork()) == 0)
+    {
+        ptrace(PTRACE_TRACEME, 0, NULL, NULL);
+        raise(SIGSTOP); /* count from here */
+        _exit(requireAll(n, modules) != 0);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFSTOPPED(status))
+        return -1;
+    ptrace(PTRACE_SETOPTIONS, pid, NULL, PTRACE_O_TRACESYSGOOD|PTRACE_O_EXITKILL);
+    while (ptrace(PTRACE_SYSCALL, pid, NULL, NULL) == 0 && waitpid(pid, &status, 0) == pid)
+    {
+        if (WIFEXITED(status)) return WEXITSTATUS(status) ? -1 : 0;
+        if (WIFSIGNALED(status)) return -1;
+        if (WSTOPSIG(status) != (SIGTRAP|0x80)) continue;
+        if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) <= 0) return -1;
+        if (info.op != PTRACE_SYSCALL_INFO_ENTRY) continue;
+        counters[TOTAL]++;
+        if (syscallCategory((long)info.entry.nr) >= 0)
+            counters[syscallCategory((long)info.entry.nr)]++;
+    }
+    return -1;
+}
+
+int main(int argc, char** argv)
+{
+    int count = 0, report, status, i;
+    struct timespec start, stop;
+    unsigned long counters[COUNTERS] = { 0 };
+
+    if (argc > 1 && strcmp(argv[1], "-c") == 0)
+    {
+        count = 1;
+        argc--;
+        argv++;
+    }
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: benchRequire [-c] <pool> <module> ...\n");
+        return 2;
+    }
+    setenv("EPICS_DRIVER_PATH", argv[1], 1);
+
+    /* keep stdout for the report, silence require */
+    fflush(stdout);
+    report = dup(1);
+    freopen("/dev/null", "w", stdout);
+
+    if (count)
+    {
+        status = countSyscalls(argc - 2, argv + 2, counters);
+        for (i = 0; i < COUNTERS; i++)
+            dprintf(report, "%s %lu\n", counterNames[i], counters[i]);
+    }
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        status = requireAll(argc - 2, argv + 2);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        dprintf(report, "time %.3f ms\n",
+            (stop.tv_sec - start.tv_sec) * 1e3 + (stop.tv_nsec - start.tv_nsec) * 1e-6);
+    }
+    if (status != 0)
+        fprintf(stderr, "benchRequire: requiring modules failed\n");
+    return status != 0;
+}
@@ -0,0 +1,46 @@
+#!/bin/bash
+# Benchmark and regression gate of the module resolution of require.
+#
+#   benchRequire.sh <output dir> [<modules> <versions> <releases> <archs> <fanout>]
+#
+# Generates a synthetic pool with genPool.sh (again only if the parameters
+# have changed), requires m1 and thus all other modules via the .dep files,
+# and prints the best time of 5 runs and the system call counts.
+# With the default parameters, the counts must not exceed the limits in
+# benchRequire.limits. Lower the limits when an optimization lowers the counts.
+
+set -e
+O=$1
+shift
+PARAMS="${1:-30} ${2:-5} ${3:-3} ${4:-3} ${5:-3}"
+POOL=$O/benchpool
+LIMITS=$(dirname $0)/benchRequire.limits
+
+if [ "$(cat $POOL/.params 2>/dev/null)" != "$PARAMS" ]
+then
+    echo "Generating pool with modules versions releases archs fanout: $PARAMS"
+    $(dirname $0)/genPool.sh $POOL $PARAMS
+    echo "$PARAMS" > $POOL/.params
+fi
+
+best=
+for run in 1 2 3 4 5
+do
+    time=$(cd $O && ./benchRequire benchpool m1 | awk '/^time/ {print $2}')
+    if [ -z "$best" ] || awk "BEGIN {exit !($time < $best)}"
+    then
+        best=$time
+    fi
+done
+echo "time $best ms"
+
+# relative, because realpath() stats each component of an absolute path
+(cd $O && ./benchRequire -c benchpool m1) > $O/benchRequire.counts
+cat $O/benchRequire.counts
+[ "$PARAMS" = "30 5 3 3 3" ] || exit 0
+awk '
+    FILENAME == ARGV[1] && !/^#/ { limit[$1] = $2; next }
+    ($1 in limit) && $2 > limit[$1] {
+        printf "FAIL: %s calls %d exceed the limit %d\n", $1, $2, limit[$1]; failed = 1 }
+    END { if (!failed) print "ok: system calls within the limits"; exit failed }
+' $LIMITS $O/benchRequire.counts
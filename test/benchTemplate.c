@@ -0,0 +1,175 @@
+/*
+* Benchmark of dbLoadTemplate with generated substitution files.
+*
+*   benchTemplate [-c] <rows> <columns> <value length> <globals>
+*
+* Writes a pattern substitution file with the given number of rows and
+* columns, values of the given length and global blocks spread over the
+* rows, parses it and prints rows per second and the bytes allocated with
+* dbmfMalloc. dbLoadRecords only counts the calls.
+* With -c, it also parses a file with 8 times the columns and fails when
+* the time per value grows by more than LINEAR_LIMIT, i.e. when building
+* the macro string of a row is not linear in its length any more.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dbmf.h>
+
+#define LINEAR_LIMIT 2.0
+
+int __dbLoadTemplate(const char* sub_file, const char* cmd_collect, const char* path);
+extern int dbTemplateMaxVars;
+
+static unsigned long records;
+static unsigned long dbmfBytes;
+static unsigned long dbmfCalls;
+
+int dbLoadRecords(const char* file, const char* subst)
+{
+    records++;
+    return 0;
+}
+
+void* dbmfMalloc(size_t size)
+{
+    dbmfBytes += size;
+    dbmfCalls++;
+    return malloc(size);
+}
+
+char* dbmfStrdup(const char* str)
+{
+    return strcpy(dbmfMalloc(strlen(str) + 1), str);
+}
+
+void dbmfFree(void* mem)
+{
+    free(mem);
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int generate(const char* filename, int rows, int columns, int length, int globals)
+{
+    FILE* file = fopen(filename, "w");
+    int row, column, i;
+
+    if (!file)
+    {
+        perror(filename);
+        return -1;
+    }
+    fprintf(file, "global { G=g }\n");
+    fprintf(file, "file \"bench.template\" {\npattern {");
+    for (column = 0; column < columns; column++)
+        fprintf(file, " C%d", column);
+    fprintf(file, " }\n");
+    for (row = 0; row < rows; row++)
+    {
+        if (globals && row % (rows / globals + 1) == 0)
+            fprintf(file, "global { G%d=$(G)%d }\n", row, row);
+        fprintf(file, "{");
+        for (column = 0; column < columns; column++)
+        {
+            /* every 4th value is quoted, every 8th references a macro */
+            if (column % 8 == 0)
+                fprintf(file, " $(G)");
+            else if (column % 4 == 0)
+                fprintf(file, " \"");
+            else
+                fprintf(file, " ");
+            for (i = 0; i < length; i++)
+                putc('a' + (row + column + i) % 26, file);
+            if (column % 8 != 0 && column % 4 == 0)
+                putc('"', file);
+        }
+        fprintf(file, " }\n");
+    }
+    fprintf(file, "}\n");
+    return fclose(file);
+}
+
+/* parse one generated file (best of 3), return seconds per value or <0 on error */
+static double bench(int rows, int columns, int length, int globals)
+{
+    const char* filename = "bench.substitutions";
+    double best = 0;
+    int run;
+
+    if (generate(filename, rows, columns, length, globals) != 0)
+        return -1;
+    /* one variable per column, MAX_VAR_FACTOR = 50 chars each in dbLoadTemplate.y */
+    dbTemplateMaxVars = columns * (length + 16) / 50 + columns + globals + 10;
+    for (run = 0; run < 3; run++)
+    {
+        double start;
+
+        records = dbmfBytes = dbmfCalls = 0;
+        start = now();
+        if (__dbLoadTemplate(filename, NULL, NULL) != 0)
+            return -1;
+        start = now() - start;
+        if (run == 0 || start < best) best = start;
+        if (records != (unsigned long)rows)
+        {
+            fprintf(stderr, "FAIL: %lu records loaded instead of %d\n", records, rows);
+            return -1;
+        }
+    }
+    printf("%d rows of %d columns of %d chars, %d globals: %.3f ms, %.0f rows/s, "
+        "dbmf %lu bytes in %lu calls\n",
+        rows, columns, length, globals, best * 1e3, rows / best, dbmfBytes, dbmfCalls);
+    remove(filename);
+    return best / ((double)rows * columns);
+}
+
+int main(int argc, char** argv)
+{
+    int check = 0;
+    int rows, columns, length, globals;
+    double perValue, perValueWide;
+
+    if (argc > 1 && strcmp(argv[1], "-c") == 0)
+    {
+        check = 1;
+        argc--;
+        argv++;
+    }
+    if (argc != 5)
+    {
+        fprintf(stderr, "usage: benchTemplate [-c] <rows> <columns> <value length> <globals>\n");
+        return 1;
+    }
+    rows = atoi(argv[1]);
+    columns = atoi(argv[2]);
+    length = atoi(argv[3]);
+    globals = atoi(argv[4]);
+    if (rows < 1 || columns < 1 || length < 1 || globals < 0)
+    {
+        fprintf(stderr, "benchTemplate: need positive numbers\n");
+        return 1;
+    }
+    if ((perValue = bench(rows, columns, length, globals)) < 0)
+        return 1;
+    if (!check)
+        return 0;
+    if ((perValueWide = bench(rows, columns * 8, length, globals)) < 0)
+        return 1;
+    if (perValueWide > perValue * LINEAR_LIMIT)
+    {
+        printf("FAIL: time per value grows %.1f times with 8 times the columns\n",
+            perValueWide / perValue);
+        return 1;
+    }
+    printf("ok: time per value grows %.1f times with 8 times the columns\n",
+        perValueWide / perValue);
+    return 0;
+}
@@ -0,0 +1,144 @@
+/*
+* Stand-ins for the EPICS base functions used by require,
+* so that require.c can be tested and benchmarked without EPICS base.
+* Mutexes, threads and time use pthreads and clock_gettime.
+* Database and iocsh functions only log what they would do
+* when the environment variable STUB_VERBOSE is set.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <dbAccess.h>
+#include <initHooks.h>
+#include <iocsh.h>
+#include <epicsTime.h>
+#include <epicsMutex.h>
+#include <epicsThread.h>
+
+volatile int interruptAccept;
+struct dbBase* pdbbase;
+mapdbfType pamapdbfType[2];
+
+#define STUB_LOG(...) do { if (getenv("STUB_VERBOSE")) printf("stub: " __VA_ARGS__); } while (0)
+
+struct rset* dbGetRset(DBADDR* addr) { return NULL; }
+long dbNameToAddr(const char* name, DBADDR* addr) { return -1; }
+void dbScanLock(void* precord) {}
+void dbScanUnlock(void* precord) {}
+long dbProcess(void* precord) { return 0; }
+
+int dbLoadDatabase(const char* file, const char* path, const char* subst)
+{
+    STUB_LOG("dbLoadDatabase %s\n", file);
+    return 0;
+}
+
+__attribute__((weak)) int dbLoadRecords(const char* file, const char* subst)
+{
+    STUB_LOG("dbLoadRecords %s %s\n", file, subst ? subst : "");
+    return 0;
+}
+
+int initHookRegister(initHookFunction func) { return 0; }
+void iocshRegister(const iocshFuncDef* def, iocshCallFunc func) {}
+
+int iocshCmd(const char* cmd)
+{
+    STUB_LOG("iocshCmd %s\n", cmd);
+    return 0;
+}
+
+__attribute__((weak)) int iocsh(const char* file)
+{
+    STUB_LOG("iocsh %s\n", file ? file : "");
+    return 0;
+}
+
+void epicsExit(int status) { exit(status); }
+
+int epicsTimeGetCurrent(epicsTimeStamp* stamp)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_REALTIME, &t);
+    stamp->secPastEpoch = t.tv_sec;
+    stamp->nsec = t.tv_nsec;
+    return 0;
+}
+
+double epicsTimeDiffInSeconds(const epicsTimeStamp* left, const epicsTimeStamp* right)
+{
+    return ((double)left->secPastEpoch - right->secPastEpoch) +
+        ((double)left->nsec - right->nsec) * 1e-9;
+}
+
+epicsMutexId epicsMutexMustCreate(void)
+{
+    pthread_mutex_t* mutex = malloc(sizeof(pthread_mutex_t));
+    pthread_mutexattr_t attr;
+
+    if (!mutex) abort();
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(mutex, &attr);
+    return mutex;
+}
+
+void epicsMutexMustLock(epicsMutexId mutex) { pthread_mutex_lock(mutex); }
+void epicsMutexUnlock(epicsMutexId mutex) { pthread_mutex_unlock(mutex); }
+
+static pthread_mutex_t onceLock = PTHREAD_MUTEX_INITIALIZER;
+
+void epicsThreadOnce(epicsThreadOnceId* id, EPICSTHREADFUNC func, void* arg)
+{
+    pthread_mutex_lock(&onceLock);
+    if (!*id)
+    {
+        func(arg);
+        *id = (epicsThreadOnceId)1;
+    }
+    pthread_mutex_unlock(&onceLock);
+}
+
+void epicsThreadSleep(double seconds)
+{
+    struct timespec t;
+    t.tv_sec = (time_t)seconds;
+    t.tv_nsec = (long)((seconds - t.tv_sec) * 1e9);
+    nanosleep(&t, NULL);
+}
+
+unsigned int epicsThreadGetStackSize(int size) { return 0; }
+
+typedef struct stubThread {
+    pthread_t thread;
+    EPICSTHREADFUNC func;
+    void* arg;
+} stubThread;
+
+static void* stubThreadMain(void* arg)
+{
+    stubThread* t = arg;
+    t->func(t->arg);
+    return NULL;
+}
+
+epicsThreadId epicsThreadCreate(const char* name, unsigned int priority,
+    unsigned int stackSize, EPICSTHREADFUNC func, void* arg)
+{
+    stubThread* t = malloc(sizeof(stubThread));
+
+    if (!t) return NULL;
+    t->func = func;
+    t->arg = arg;
+    if (pthread_create(&t->thread, NULL, stubThreadMain, t) != 0)
+    {
+        free(t);
+        return NULL;
+    }
+    pthread_detach(t->thread);
+    return t;
+}
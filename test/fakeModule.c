@@ -0,0 +1,24 @@
+/*
+* A module library for the tests.
+* Defines _<MODULE>LibRelease like driver.makefile does,
+* and _<OTHER>LibRelease for a second module in the same library.
+*/
+
+#define STR2(x) #x
+#define STR(x) STR2(x)
+#define LIBRELEASE2(m) _##m##LibRelease
+#define LIBRELEASE(m) LIBRELEASE2(m)
+
+const char LIBRELEASE(MODULE)[] = STR(VERSION);
+#ifdef OTHER
+const char LIBRELEASE(OTHER)[] = "0.1";
+#endif
+
+/* called by require after loading the dbd file */
+#define REGISTER2(m) m##_registerRecordDeviceDriver
+#define REGISTER(m) REGISTER2(m)
+
+int REGISTER(MODULE)(void* pdbbase)
+{
+    return 0;
+}
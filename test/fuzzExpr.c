@@ -0,0 +1,71 @@
+/*
+* Fuzz target of replaceExpressions for libFuzzer and AFL.
+*
+* libFuzzer: clang -DLIBFUZZER -fsanitize=fuzzer,address fuzzExpr.c ../expr.c
+* AFL:       afl-clang-fast fuzzExpr.c ../expr.c, input from stdin
+* Otherwise it runs each file given as argument (or stdin) once, e.g. to
+* reproduce a crash or to check the seeds.
+*
+* The result must be null terminated within the buffer, and its length
+* must be returned unless it did not fit, for every buffer size.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../expr.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    static const size_t buffersizes[] = { 1, 2, 7, 64, 4096 };
+    char* source = malloc(size + 1);
+    size_t i;
+
+    if (!source) return 0;
+    memcpy(source, data, size);
+    source[size] = 0;
+    for (i = 0; i < sizeof(buffersizes)/sizeof(buffersizes[0]); i++)
+    {
+        size_t buffersize = buffersizes[i];
+        char* buffer = malloc(buffersize);
+        size_t n;
+
+        if (!buffer) break;
+        n = replaceExpressions(source, buffer, buffersize);
+        if (n > buffersize || (n < buffersize && strnlen(buffer, buffersize) != n) ||
+            strnlen(buffer, buffersize) == buffersize)
+            abort();
+        free(buffer);
+    }
+    free(source);
+    return 0;
+}
+
+#ifndef LIBFUZZER
+static void runFile(FILE* file)
+{
+    static char data[1<<16];
+    size_t size = fread(data, 1, sizeof(data), file);
+    LLVMFuzzerTestOneInput((const uint8_t*)data, size);
+}
+
+int main(int argc, char** argv)
+{
+    int i;
+
+    if (argc < 2) runFile(stdin);
+    for (i = 1; i < argc; i++)
+    {
+        FILE* file = fopen(argv[i], "r");
+        if (!file)
+        {
+            perror(argv[i]);
+            return 1;
+        }
+        runFile(file);
+        fclose(file);
+    }
+    return 0;
+}
+#endif
@@ -0,0 +1,52 @@
+#!/bin/bash
+# Generate a synthetic module pool for benchRequire.
+#
+#   genPool.sh <pool> <modules> <versions> <releases> <archs> <fanout>
+#
+# Modules m1 ... m<modules> each have the versions 1.1.0 ... 1.<versions>.0,
+# each built for <releases> EPICS releases and <archs> architectures.
+# The first release is $EPICSVERSION and the first architecture is $T_A,
+# the others are R<n>.0.0 and arch<n>. Module m<i> depends on up to
+# <fanout> modules m<i+1> .... Only the highest version for $EPICSVERSION
+# and $T_A has a real library (built from fakeModule.c with $CC), because
+# only that one is loaded. The others have empty files.
+
+set -e
+POOL=$1 MODULES=${2:-30} VERSIONS=${3:-5} RELEASES=${4:-3} ARCHS=${5:-3} FANOUT=${6:-3}
+: ${CC:=cc} ${EPICSVERSION:?} ${T_A:?}
+SRC=$(dirname $0)/fakeModule.c
+
+rm -rf $POOL
+for ((i = 1; i <= MODULES; i++))
+do
+    for ((v = 1; v <= VERSIONS; v++))
+    do
+        for ((r = 1; r <= RELEASES; r++))
+        do
+            [ $r = 1 ] && rel=$EPICSVERSION || rel=$r.0.0
+            dir=$POOL/m$i/1.$v.0/R$rel
+            mkdir -p $dir/dbd
+            echo "# m$i" > $dir/dbd/m$i.dbd
+            for ((a = 1; a <= ARCHS; a++))
+            do
+                [ $a = 1 ] && arch=$T_A || arch=arch$a
+                mkdir -p $dir/lib/$arch
+                for ((d = i + 1; d <= i + FANOUT && d <= MODULES; d++))
+                do
+                    echo "m$d 1"
+                done > $dir/lib/$arch/m$i.dep
+                if [ $v = $VERSIONS ] && [ $r = 1 ] && [ $a = 1 ]
+                then
+                    $CC -fPIC -shared -DMODULE=m$i -DVERSION=1.$v.0 $SRC -o $dir/lib/$arch/libm$i.so &
+                else
+                    : > $dir/lib/$arch/libm$i.so
+                fi
+            done
+        done
+    done
+done
+wait
+for ((i = 1; i <= MODULES; i++))
+do
+    [ -s $POOL/m$i/1.$VERSIONS.0/R$EPICSVERSION/lib/$T_A/libm$i.so ] || { echo "Building libm$i.so failed" >&2; exit 1; }
+done
@@ -0,0 +1,209 @@
+/*
+* Small implementation of the EPICS macLib functions used by runScript
+* and dbLoadTemplate, for the tests only.
+* Supports $(name), ${name}, $(name=default), nested references in
+* values, scopes and the "environ" pair for environment variables.
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <macLib.h>
+
+typedef struct macro {
+    struct macro* next;
+    char* name;
+    char* value;
+    int scope;
+} macro;
+
+struct mac_handle {
+    macro* macros;
+    int scope;
+    int useEnviron;
+};
+
+long macCreateHandle(MAC_HANDLE** handle, char* pairs[])
+{
+    MAC_HANDLE* h = calloc(1, sizeof(MAC_HANDLE));
+
+    if (!h) return -1;
+    for (; pairs && pairs[0]; pairs += 2)
+    {
+        if (pairs[0][0] == 0 && pairs[1] && strcmp(pairs[1], "environ") == 0)
+            h->useEnviron = 1;
+        else
+            macPutValue(h, pairs[0], pairs[1]);
+    }
+    *handle = h;
+    return 0;
+}
+
+void macSuppressWarning(MAC_HANDLE* handle, int suppress) {}
+
+static const char* lookup(MAC_HANDLE* h, const char* name, size_t len)
+{
+    macro* m;
+    static char buffer[256];
+
+    for (m = h->macros; m; m = m->next)
+        if (strlen(m->name) == len && strncmp(m->name, name, len) == 0)
+            return m->value;
+    if (h->useEnviron && len < sizeof(buffer))
+    {
+        memcpy(buffer, name, len);
+        buffer[len] = 0;
+        return getenv(buffer);
+    }
+    return NULL;
+}
+
+/* expand src into dst (at most capacity chars), return full length, <0 on undefined */
+static long expand(MAC_HANDLE* h, const char* src, char* dst, long capacity, long len, int* undefined, int depth)
+{
+    while (*src)
+    {
+        if (src[0] == '$' && (src[1] == '(' || src[1] == '{'))
+        {
+            char close = src[1] == '(' ? ')' : '}';
+            const char* name = src + 2;
+            const char* end = name;
+            const char* eq = NULL;
+            const char* value;
+            int level = 0;
+
+            for (; *end && (level || *end != close); end++)
+            {
+                if (*end == '(' || *end == '{') level++;
+                if (*end == ')' || *end == '}') level--;
+                if (*end == '=' && !level && !eq) eq = end;
+            }
+            value = lookup(h, name, (eq ? eq : end) - name);
+            if (value && depth < 20)
+                len = expand(h, value, dst, capacity, len, undefined, depth + 1);
+            else if (eq)
+            {
+                char* deflt = strndup(eq + 1, end - eq - 1);
+                len = expand(h, deflt, dst, capacity, len, undefined, depth + 1);
+                free(deflt);
+            }
+            else
+            {
+                const char* p;
+                *undefined = 1;
+                for (p = src; p < end + (*end != 0); p++, len++)
+                    if (len < capacity) dst[len] = *p;
+            }
+            src = *end ? end + 1 : end;
+            continue;
+        }
+        if (len < capacity) dst[len] = *src;
+        len++;
+        src++;
+    }
+    return len;
+}
+
+long macExpandString(MAC_HANDLE* handle, const char* src, char* dst, long capacity)
+{
+    int undefined = 0;
+    long len = expand(handle, src, dst, capacity, 0, &undefined, 0);
+
+    if (capacity > 0) dst[len < capacity ? len : capacity - 1] = 0;
+    if (len > capacity - 1) len = capacity - 1;
+    return undefined ? -len : len;
+}
+
+long macPutValue(MAC_HANDLE* handle, const char* name, const char* value)
+{
+    macro* m;
+
+    for (m = handle->macros; m; m = m->next)
+        if (m->scope == handle->scope && strcmp(m->name, name) == 0) break;
+    if (!m)
+    {
+        m = calloc(1, sizeof(macro));
+        if (!m) return -1;
+        m->name = strdup(name);
+        m->scope = handle->scope;
+        m->next = handle->macros;
+        handle->macros = m;
+    }
+    free(m->value);
+    m->value = value ? strdup(value) : NULL;
+    return value ? (long)strlen(value) : 0;
+}
+
+long macParseDefns(MAC_HANDLE* handle, const char* defns, char*** pairs)
+{
+    /* pairs and the copy of the string in one block, freed by the caller */
+    size_t npointers = 2 * strlen(defns) + 2;
+    char** p = calloc(1, npointers * sizeof(char*) + strlen(defns) + 1);
+    char* copy;
+    char* save = NULL;
+    char* item;
+    int n = 0;
+
+    if (!p) return -1;
+    copy = strcpy((char*)(p + npointers), defns);
+    for (item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save))
+    {
+        char* eq = strchr(item, '=');
+        while (*item == ' ') item++;
+        if (!eq) continue;
+        *eq = 0;
+        p[n++] = item;
+        p[n++] = eq + 1;
+    }
+    *pairs = p;
+    return n / 2;
+}
+
+long macInstallMacros(MAC_HANDLE* handle, char** pairs)
+{
+    long n = 0;
+
+    for (; pairs && pairs[0]; pairs += 2, n++)
+        macPutValue(handle, pairs[0], pairs[1]);
+    return n;
+}
+
+long macPushScope(MAC_HANDLE* handle)
+{
+    return ++handle->scope;
+}
+
+long macPopScope(MAC_HANDLE* handle)
+{
+    macro** pm = &handle->macros;
+
+    while (*pm)
+    {
+        macro* m = *pm;
+        if (m->scope == handle->scope)
+        {
+            *pm = m->next;
+            free(m->name);
+            free(m->value);
+            free(m);
+        }
+        else pm = &m->next;
+    }
+    if (handle->scope > 0) handle->scope--;
+    return 0;
+}
+
+long macDeleteHandle(MAC_HANDLE* handle)
+{
+    while (handle->macros)
+    {
+        macro* m = handle->macros;
+        handle->macros = m->next;
+        free(m->name);
+        free(m->value);
+        free(m);
+    }
+    free(handle);
+    return 0;
+}
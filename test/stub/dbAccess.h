@@ -0,0 +1,20 @@
+/* test stub of the EPICS header dbAccess.h, only what require uses */
+#pragma once
+#include <stddef.h>
+#define PVNAME_STRINGSZ 61
+#define MAX_STRING_SIZE 40
+#define DBF_STRING 0
+#define DBF_CHAR 1
+#define DBF_DOUBLE 9
+typedef struct dbCommon { char name[61]; } dbCommon;
+typedef struct dbAddr { dbCommon* precord; void* pfield; short field_type; long no_elements; } DBADDR;
+struct rset { long (*get_array_info)(DBADDR*, long*, long*); long (*put_array_info)(DBADDR*, long); };
+struct rset* dbGetRset(DBADDR*);
+typedef struct { const char* strvalue; } mapdbfType;
+extern mapdbfType pamapdbfType[];
+long dbNameToAddr(const char*, DBADDR*);
+int dbLoadDatabase(const char*, const char*, const char*);
+int dbLoadRecords(const char*, const char*);
+extern volatile int interruptAccept;
+extern struct dbBase* pdbbase;
+void dbScanLock(void*); void dbScanUnlock(void*); long dbProcess(void*);
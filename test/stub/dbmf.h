@@ -0,0 +1,5 @@
+/* test stub of the EPICS header dbmf.h, only what require uses */
+#pragma once
+void* dbmfMalloc(size_t);
+char* dbmfStrdup(const char*);
+void dbmfFree(void*);
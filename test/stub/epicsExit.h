@@ -0,0 +1,3 @@
+/* test stub of the EPICS header epicsExit.h, only what require uses */
+#pragma once
+void epicsExit(int);
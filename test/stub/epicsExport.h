@@ -0,0 +1,4 @@
+/* test stub of the EPICS header epicsExport.h, only what require uses */
+#pragma once
+#define epicsExportRegistrar(f) void* pvar_func_##f = (void*)f
+#define epicsExportAddress(t,v) void* pvar_##t##_##v = (void*)&v
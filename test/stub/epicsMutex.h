@@ -0,0 +1,6 @@
+/* test stub of the EPICS header epicsMutex.h, only what require uses */
+#pragma once
+typedef void* epicsMutexId;
+epicsMutexId epicsMutexMustCreate(void);
+void epicsMutexMustLock(epicsMutexId);
+void epicsMutexUnlock(epicsMutexId);
@@ -0,0 +1,4 @@
+/* test stub of the EPICS header epicsStdio.h, only what require uses */
+#pragma once
+#include <stdio.h>
+#define epicsGetStdout() stdout
@@ -0,0 +1,12 @@
+/* test stub of the EPICS header epicsThread.h, only what require uses */
+#pragma once
+void epicsThreadSleep(double);
+typedef void (*EPICSTHREADFUNC)(void*);
+typedef void* epicsThreadId;
+enum { epicsThreadStackSmall, epicsThreadStackMedium, epicsThreadStackBig };
+#define epicsThreadPriorityLow 10
+unsigned int epicsThreadGetStackSize(int);
+epicsThreadId epicsThreadCreate(const char*, unsigned int, unsigned int, EPICSTHREADFUNC, void*);
+typedef epicsThreadId epicsThreadOnceId;
+#define EPICS_THREAD_ONCE_INIT 0
+void epicsThreadOnce(epicsThreadOnceId*, EPICSTHREADFUNC, void*);
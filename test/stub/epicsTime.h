@@ -0,0 +1,5 @@
+/* test stub of the EPICS header epicsTime.h, only what require uses */
+#pragma once
+typedef struct { unsigned secPastEpoch, nsec; } epicsTimeStamp;
+int epicsTimeGetCurrent(epicsTimeStamp*);
+double epicsTimeDiffInSeconds(const epicsTimeStamp*, const epicsTimeStamp*);
@@ -0,0 +1,6 @@
+/* test stub of the EPICS header epicsVersion.h, only what require uses */
+#pragma once
+#define EPICS_VERSION 3
+#define EPICS_REVISION 14
+#define EPICS_MODIFICATION 12
+#define EPICS_VERSION_INT 1
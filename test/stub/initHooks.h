@@ -0,0 +1,5 @@
+/* test stub of the EPICS header initHooks.h, only what require uses */
+#pragma once
+typedef enum { initHookAtBeginning, initHookAfterInterruptAccept, initHookAfterFinishDevSup, initHookAfterIocRunning, initHookAfterInitDatabase } initHookState;
+typedef void (*initHookFunction)(initHookState state);
+int initHookRegister(initHookFunction func);
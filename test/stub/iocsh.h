@@ -0,0 +1,10 @@
+/* test stub of the EPICS header iocsh.h, only what require uses */
+#pragma once
+typedef enum { iocshArgInt, iocshArgDouble, iocshArgString, iocshArgPdbbase, iocshArgArgv, iocshArgPersistentString } iocshArgType;
+typedef union iocshArgBuf { int ival; double dval; char* sval; void* vval; struct { int ac; char** av; } aval; } iocshArgBuf;
+typedef struct iocshArg { const char* name; iocshArgType type; } iocshArg;
+typedef struct iocshFuncDef { const char* name; int nargs; const iocshArg* const* arg; } iocshFuncDef;
+typedef void (*iocshCallFunc)(const iocshArgBuf*);
+void iocshRegister(const iocshFuncDef*, iocshCallFunc);
+int iocshCmd(const char*);
+int iocsh(const char*);
@@ -0,0 +1,12 @@
+/* test stub of the EPICS header macLib.h, only what require uses */
+#pragma once
+typedef struct mac_handle MAC_HANDLE;
+long macCreateHandle(MAC_HANDLE**, char*[]);
+void macSuppressWarning(MAC_HANDLE*, int);
+long macExpandString(MAC_HANDLE*, const char*, char*, long);
+long macPutValue(MAC_HANDLE*, const char*, const char*);
+long macParseDefns(MAC_HANDLE*, const char*, char***);
+long macInstallMacros(MAC_HANDLE*, char**);
+long macPushScope(MAC_HANDLE*);
+long macPopScope(MAC_HANDLE*);
+long macDeleteHandle(MAC_HANDLE*);
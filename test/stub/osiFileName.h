@@ -0,0 +1,4 @@
+/* test stub of the EPICS header osiFileName.h, only what require uses */
+#pragma once
+#define OSI_PATH_LIST_SEPARATOR ":"
+#define OSI_PATH_SEPARATOR "/"
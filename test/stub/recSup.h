@@ -0,0 +1 @@
+/* test stub of the EPICS header recSup.h, nothing of it is needed */
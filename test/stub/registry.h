@@ -0,0 +1 @@
+/* test stub of the EPICS header registry.h, nothing of it is needed */
@@ -0,0 +1,6 @@
+/* test stub of the EPICS header shareLib.h, only what require uses */
+#pragma once
+#define epicsShareFunc
+#define epicsShareAPI
+#define epicsShareExtern extern
+#include <stdarg.h>
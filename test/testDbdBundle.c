@@ -0,0 +1,79 @@
+/*
+* Dbd bundle: the bundle is used only while its header matches the
+* module dbd files, the EPICS release and the loaded module versions.
+*/
+
+#include "../require.c"
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (cond) printf("ok: " __VA_ARGS__); \
+    else { printf("FAIL: " __VA_ARGS__); failures++; } printf("\n"); } while (0)
+
+static char base[PATH_MAX];
+
+/* write a bundle with modules a 1.0 and b 2.0 and forget the previous one */
+static void makeBundle(const char* releaseOfB, long long mtimeOffset)
+{
+    char filename[PATH_MAX+20];
+    struct stat st;
+    FILE* file;
+
+    snprintf(filename, sizeof(filename), "%s/bundle.dbd", base);
+    if ((file = fopen(filename, "w")) == NULL) exit(2);
+    stat(strcat(strcpy(filename, base), "/a/1.0/R" EPICSVERSION "/dbd/a.dbd"), &st);
+    fprintf(file, "#!module a 1.0 %s %lld %s\n", epicsRelease, (long long)st.st_mtime + mtimeOffset, filename);
+    stat(strcat(strcpy(filename, base), "/b/2.0/R" EPICSVERSION "/dbd/b.dbd"), &st);
+    fprintf(file, "#!module b 2.0 %s %lld %s\n", releaseOfB, (long long)st.st_mtime, filename);
+    fprintf(file, "menu(m) {\n}\n");
+    fclose(file);
+    memset(&dbdBundle, 0, sizeof(dbdBundle));
+}
+
+/* dbdBundleLoad for a library in the module release directory */
+static int load(const char* module, const char* version)
+{
+    char libfile[PATH_MAX+100];
+    int dirlen = snprintf(libfile, sizeof(libfile), "%s/%s/%s/R%s/", base, module, version, epicsRelease);
+
+    strcat(libfile, "lib/" T_A "/lib.so");
+    return dbdBundleLoad(module, version, libfile, dirlen);
+}
+
+int main(int argc, char** argv)
+{
+    char command[PATH_MAX*4];
+
+    if (!realpath(argc > 1 ? argv[1] : "O.test", base)) return 2;
+    strcat(base, "/dbdbundle");
+    snprintf(command, sizeof(command),
+        "rm -rf %s && mkdir -p %s/a/1.0/R%s/dbd %s/b/2.0/R%s/dbd && "
+        "echo 'registrar(a)' > %s/a/1.0/R%s/dbd/a.dbd && echo 'registrar(b)' > %s/b/2.0/R%s/dbd/b.dbd",
+        base, base, EPICSVERSION, base, EPICSVERSION, base, EPICSVERSION, base, EPICSVERSION);
+    if (system(command) != 0) return 2;
+    setenv("REQUIRE_DBD_BUNDLE", strcat(strcpy(command, base), "/bundle.dbd"), 1);
+
+    makeBundle(epicsRelease, 0);
+    CHECK(load("a", "1.0") == 1 && dbdBundle.state == 2, "bundle loaded for a");
+    CHECK(load("b", "2.0") == 1, "bundle used for b");
+
+    makeBundle(epicsRelease, 0);
+    CHECK(load("a", "1.1") == 0 && dbdBundle.state == 1, "bundle not used for another version");
+    CHECK(load("b", "2.0") == 1 && dbdBundle.state == 2, "bundle still used for other modules");
+
+    makeBundle(epicsRelease, -1);
+    CHECK(load("b", "2.0") == 0 && dbdBundle.state == -1, "bundle not used when a dbd file changed");
+
+    makeBundle("3.15.0", 0);
+    CHECK(load("a", "1.0") == 0 && dbdBundle.state == -1, "bundle not used for another EPICS release");
+
+    makeBundle(epicsRelease, 0);
+    CHECK(dbdBundleLoad("a", "1.0", "/elsewhere/a/1.0/lib/lib.so", 17) == 0,
+        "bundle not used for a module in another directory");
+
+    makeBundle(epicsRelease, 0);
+    registerModule("b", "1.5", NULL);
+    CHECK(load("a", "1.0") == 0 && dbdBundle.state == -1, "bundle not used when b is loaded in another version");
+
+    return failures != 0;
+}
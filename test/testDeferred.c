@@ -0,0 +1,73 @@
+/*
+* Deferred require: the shell runs scripts, which look up SCRIPT_PATH and
+* read the environment, while the deferred thread loads a chain of modules.
+* The deferred thread must change neither of them.
+* Built with -fsanitize=thread, which reports unsynchronized accesses.
+*/
+
+#include "../require.c"
+
+#define MODULES 8
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (cond) printf("ok: " __VA_ARGS__); \
+    else { printf("FAIL: " __VA_ARGS__); failures++; } printf("\n"); } while (0)
+
+static int deferredRunning(void)
+{
+    int running;
+
+    REQUIRE_LOCK();
+    running = deferredThreadRunning;
+    REQUIRE_UNLOCK();
+    return running;
+}
+
+int main(int argc, char** argv)
+{
+    char base[PATH_MAX], filename[PATH_MAX*2];
+    char* scriptPath;
+    FILE* file;
+    int i, out, runs = 0, errors = 0;
+
+    if (!realpath(argc > 1 ? argv[1] : "O.test", base)) return 2;
+    strcat(base, "/deferpool");
+    /* the libraries are built by the Makefile, d<i> depends on d<i+1>, the last on nothing */
+    for (i = 1; i <= MODULES; i++)
+    {
+        snprintf(filename, sizeof(filename), "%s/d%d/1.0/R%s/lib/%s/d%d.dep",
+            base, i, EPICSVERSION, T_A, i);
+        if ((file = fopen(filename, "w")) == NULL) return 2;
+        if (i < MODULES) fprintf(file, "d%d 1.0\n", i + 1);
+        fclose(file);
+    }
+    snprintf(filename, sizeof(filename), "%s/test.cmd", base);
+    if ((file = fopen(filename, "w")) == NULL) return 2;
+    fprintf(file, "# found in SCRIPT_PATH\nepicsEnvShow $(d1_VERSION=none)\n");
+    fclose(file);
+    setenv("EPICS_DRIVER_PATH", base, 1);
+    setenv("SCRIPT_PATH", base, 1);
+    scriptPath = strdup(getenv("SCRIPT_PATH"));
+
+    /* without what require and runScript print */
+    fflush(stdout);
+    out = dup(1);
+    if (!freopen("/dev/null", "w", stdout)) return 2;
+    interruptAccept = 1;
+    requireDeferred("d1", NULL);
+    do
+    {
+        if (runScript("test.cmd", NULL) != 0) errors++;
+        runs++;
+    } while (deferredRunning() || runs < 10);
+    fflush(stdout);
+    dup2(out, 1);
+
+    CHECK(errors == 0, "%d scripts run while deferred require was running", runs);
+    snprintf(filename, sizeof(filename), "d%d", MODULES);
+    CHECK(getLibVersion("d1") && getLibVersion(filename), "d1 ... d%d loaded deferred", MODULES);
+    CHECK(getenv("d1_VERSION") == NULL && getenv("d1_DIR") == NULL, "deferred require did not set d1_VERSION and d1_DIR");
+    CHECK(strcmp(getenv("SCRIPT_PATH"), scriptPath) == 0, "deferred require did not change SCRIPT_PATH");
+    return failures != 0;
+}
@@ -0,0 +1,64 @@
+/*
+* Driver path: module directories are opened and files below them are
+* looked up relative to the kept open driver path directories, which
+* follow a swapped pool symlink only after requireRescan.
+*/
+
+#include "../require.c"
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (cond) printf("ok: " __VA_ARGS__); \
+    else { printf("FAIL: " __VA_ARGS__); failures++; } printf("\n"); } while (0)
+
+/* the only version directory of module mod in the first driver path directory */
+static const char* version(const char* driverpath)
+{
+    static char name[256];
+    size_t count;
+    driverDir* dirs = getDriverPath(driverpath, &count);
+    moduleDir* d;
+    struct dirent* e;
+
+    name[0] = 0;
+    if (count < 1 || (d = openModuleDir(dirs[0].fd, "mod", "")) == NULL) return name;
+    while ((e = readModuleDir(d)) != NULL)
+        if (e->d_name[0] != '.') strcpy(name, e->d_name);
+    closeModuleDir(d);
+    return name;
+}
+
+int main(int argc, char** argv)
+{
+    char base[PATH_MAX], command[PATH_MAX*4], pool[PATH_MAX*2];
+
+    if (!realpath(argc > 1 ? argv[1] : "O.test", base)) return 2;
+    strcat(base, "/driverpath");
+    snprintf(command, sizeof(command),
+        "rm -rf %s && mkdir -p %s/pool1/mod/1.0 %s/pool2/mod/2.0 && ln -s pool1 %s/pool",
+        base, base, base, base);
+    if (system(command) != 0) return 2;
+    snprintf(pool, sizeof(pool), "%s/pool", base);
+
+    CHECK(strcmp(version(pool), "1.0") == 0, "found %s in first pool", version(pool));
+    snprintf(command, sizeof(command), "ln -sfn pool2 %s/pool", base);
+    if (system(command) != 0) return 2;
+    CHECK(strcmp(version(pool), "1.0") == 0, "still found %s after swapping the pool symlink", version(pool));
+    {
+        /* names below the driver path directory are looked up relative to it */
+        char filename[PATH_MAX*3];
+        size_t count;
+
+        fileBase.fd = getDriverPath(pool, &count)[0].fd;
+        fileBase.len = snprintf(filename, sizeof(filename), "%s/", pool);
+        fileBase.path = filename;
+        strcat(filename, "mod/1.0");
+        CHECK(fileExists(filename), "%s found in the open pool", filename);
+        strcpy(filename + fileBase.len, "mod/2.0");
+        CHECK(!fileExists(filename), "%s not found in the open pool", filename);
+        fileBase.path = NULL;
+    }
+    requireRescan();
+    CHECK(strcmp(version(pool), "2.0") == 0, "found %s after requireRescan", version(pool));
+    return failures != 0;
+}
@@ -0,0 +1,103 @@
+/*
+* Expressions: every "x=<expression>" in ../testscript followed by
+* "# $(x) should be: <result>" must give that result. Results that do
+* not fit must be reported, and runScript must refuse values that grow
+* without bound instead of exhausting the memory.
+*/
+
+#include "../require.c"
+#include "../expr.h"
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (cond) printf("ok: " __VA_ARGS__); \
+    else { printf("FAIL: " __VA_ARGS__); failures++; } printf("\n"); } while (0)
+
+static void trim(char* s)
+{
+    size_t l = strlen(s);
+    while (l > 0 && isspace((unsigned char)s[l-1])) s[--l] = 0;
+}
+
+/* macLib removes the quotes when $(x) is expanded */
+static void unquote(char* s)
+{
+    char* w = s;
+    for (; *s; s++)
+        if (*s != '"' && *s != '\'') *w++ = *s;
+    *w = 0;
+}
+
+static void testScript(const char* filename)
+{
+    FILE* file = fopen(filename, "r");
+    char line[1024], expression[1024], result[1024];
+    const char* prefix = "# $(x) should be: ";
+    int n = 0;
+
+    if (!file)
+    {
+        perror(filename);
+        failures++;
+        return;
+    }
+    expression[0] = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        trim(line);
+        if (strncmp(line, "x=", 2) == 0)
+        {
+            strcpy(expression, line + 2);
+            continue;
+        }
+        if (strncmp(line, prefix, strlen(prefix)) != 0) continue;
+        replaceExpressions(expression, result, sizeof(result));
+        unquote(result);
+        CHECK(strcmp(result, line + strlen(prefix)) == 0, "%s => %s", expression, result);
+        n++;
+    }
+    fclose(file);
+    CHECK(n > 30, "%d expressions checked", n);
+}
+
+static void testSizes(void)
+{
+    char buffer[16];
+    size_t n;
+
+    n = replaceExpressions("%x 255+1", buffer, sizeof(buffer));
+    CHECK(n == 3 && strcmp(buffer, "100") == 0, "result length %d", (int)n);
+    n = replaceExpressions("%20d 1", buffer, sizeof(buffer));
+    CHECK(n == sizeof(buffer), "too long result reported");
+    n = replaceExpressions("%99999999999999999d 1", buffer, sizeof(buffer));
+    CHECK(n == sizeof(buffer), "huge width reported");
+    n = replaceExpressions("1+1", buffer, 1);
+    CHECK(n == 1 && buffer[0] == 0, "buffer of size 1");
+}
+
+static void testRunScript(const char* dir)
+{
+    char filename[PATH_MAX*2];
+    char absdir[PATH_MAX];
+    FILE* file;
+
+    if (!realpath(dir, absdir)) return;
+    snprintf(filename, sizeof(filename), "%s/huge.cmd", absdir); /* relative would use SCRIPT_PATH */
+    if ((file = fopen(filename, "w")) == NULL)
+    {
+        perror(filename);
+        failures++;
+        return;
+    }
+    fprintf(file, "x=%%999999999999d 1\n");
+    fclose(file);
+    CHECK(runScript(filename, NULL) != 0, "runScript refuses a huge value");
+}
+
+int main(int argc, char** argv)
+{
+    testScript("../testscript");
+    testSizes();
+    testRunScript(argc > 1 ? argv[1] : "O.test");
+    return failures != 0;
+}
@@ -0,0 +1,46 @@
+/*
+* registerExternalModules must find the modules of all libraries linked
+* into the program and the program itself, built as PIE and as non-PIE
+* (ET_EXEC), and derive a location only for libraries in the pool layout
+* <module>/<version>/R<release>/lib/<arch>/lib<module>.so.
+*/
+
+#include "../require.c"
+
+const char _mainLibRelease[] = "7.7";
+
+/* referenced to link the libraries */
+extern const char _fooLibRelease[], _barLibRelease[], _bazLibRelease[];
+const char* const linked[] = { _fooLibRelease, _barLibRelease, _bazLibRelease };
+
+static int failures;
+
+static void check(const char* module, const char* version, const char* locationEnd)
+{
+    const char* v = getLibVersion(module);
+    const char* l = getLibLocation(module);
+    size_t ll = l ? strlen(l) : 0;
+    size_t le = strlen(locationEnd);
+
+    /* an empty locationEnd means no location at all */
+    if (!v || strcmp(v, version) != 0 || !l || ll < le || strcmp(l + ll - le, locationEnd) != 0 ||
+        (le == 0 && ll != 0))
+    {
+        fprintf(stderr, "FAIL: %s version \"%s\" location \"%s\", expected \"%s\" \"...%s\"\n",
+            module, v ? v : "(none)", l ? l : "(none)", version, locationEnd);
+        failures++;
+    }
+    else
+        printf("ok: %s %s \"%s\"\n", module, v, l);
+}
+
+int main()
+{
+    registerExternalModules();
+    check("main", "7.7", "");
+    check("foo", "1.2.3", "/pool/foo/1.2.3/R" EPICSVERSION "/");
+    check("other", "0.1", "");          /* not named like its library */
+    check("bar", "4.5", "");            /* not in the pool layout */
+    check("baz", "1.0", "");            /* pool layout of another architecture */
+    return failures != 0;
+}
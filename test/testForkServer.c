@@ -0,0 +1,44 @@
+/*
+* Fork server for testForkServer.sh: registers a module like a startup
+* script would have required it and serves the fifo $REQUIRE_FORK_SERVER.
+* With the argument "thread", another thread runs before, which the fork
+* server must refuse.
+* The forked IOC "runs" its startup script by printing it.
+*/
+
+#include "../require.c"
+
+/* instead of the iocsh stub: show what the forked IOC would execute */
+int iocsh(const char* file)
+{
+    FILE* script;
+    char line[4096];
+
+    if (!file) return 0;
+    if ((script = fopen(file, "r")) == NULL)
+    {
+        perror(file);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), script))
+        printf("forked IOC %s: %s", getenv("IOC"), line);
+    fclose(script);
+    return 0;
+}
+
+static void idle(void* arg)
+{
+    epicsThreadSleep(10);
+}
+
+int main(int argc, char** argv)
+{
+    registerModule("served", "1.0", NULL);
+    if (argc > 1 && strcmp(argv[1], "thread") == 0)
+    {
+        epicsThreadCreate("idle", 0, 0, idle, NULL);
+        epicsThreadSleep(.1);
+    }
+    requireForkServer(NULL);
+    return 1;
+}
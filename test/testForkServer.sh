@@ -0,0 +1,59 @@
+#!/bin/bash
+# Start testForkServer as fork server and fork an IOC from it with
+# "iocsh --fork", in a fake EPICS installation in the output directory.
+# Check as well that the fork server refuses a fifo others can write to
+# and refuses to start with other threads running.
+
+O=$(cd ${1:-O.test} && pwd)
+IOCSH=$(cd $(dirname $0)/.. && pwd)/iocsh
+SERVER=$O/testForkServer
+T=$O/forktest
+
+rm -rf $T
+mkdir -p $T/base-7.0.7/configure $T/base-7.0.7/bin/linux-x86_64 \
+    $T/modules/require/1.0.0/R7.0.7/lib/linux-x86_64 $T/tmp $T/ioc
+printf 'EPICS_VERSION=7\nEPICS_REVISION=0\nEPICS_MODIFICATION=7\n' > $T/base-7.0.7/configure/CONFIG_BASE_VERSION
+touch $T/modules/require/1.0.0/R7.0.7/lib/linux-x86_64/librequire.so
+
+export EPICS_BASE=$T/base-7.0.7 EPICS_HOST_ARCH=linux-x86_64 EPICS_MODULES=$T/modules
+export IOCSH_CACHE=/dev/null IOCSH_TMP=$T/tmp
+FIFO=$T/tmp/iocsh.${USER:-$(whoami)}/forkserver.R7.0.7.linux-x86_64
+
+fail() {
+    echo "FAIL: $*" >&2
+    kill $server 2>/dev/null
+    exit 1
+}
+
+# the client creates the private fifo directory
+(cd $T/ioc && setsid -w $IOCSH --fork -n noserver -c 'echo hi' > $T/noserver.out 2>&1) 2>/dev/null
+grep -q "No fork server" $T/noserver.out || fail "client without server: $(cat $T/noserver.out)"
+[ "$(stat -c %a ${FIFO%/*})" = 700 ] || fail "fifo directory mode $(stat -c %a ${FIFO%/*})"
+
+# a fifo others can write to
+mkfifo -m 666 $FIFO
+REQUIRE_FORK_SERVER=$FIFO timeout 5 $SERVER > $T/server.out 2>&1
+grep -q "must be a fifo of user" $T/server.out || fail "accepted fifo with mode 666: $(cat $T/server.out)"
+rm $FIFO
+
+# other threads
+REQUIRE_FORK_SERVER=$FIFO timeout 5 $SERVER thread > $T/server.out 2>&1
+grep -q "other threads running" $T/server.out || fail "accepted running threads: $(cat $T/server.out)"
+
+REQUIRE_FORK_SERVER=$FIFO $SERVER > $T/server.out 2>&1 &
+server=$!
+for i in 1 2 3 4 5 6 7 8 9 10
+do
+    [ -p $FIFO ] && break
+    sleep .1
+done
+[ "$(stat -c %a $FIFO)" = 600 ] || fail "fifo mode $(stat -c %a $FIFO)"
+
+# through a pipe because the forked IOC opens the console of the client anew
+(cd $T/ioc && setsid -w $IOCSH --fork -n testioc -c 'echo hello' 2>&1 | cat > $T/client.out) 2>/dev/null
+grep -q "IOC forked from $FIFO" $T/client.out || fail "no IOC forked: $(cat $T/client.out)"
+grep -q "forked IOC testioc: echo hello" $T/client.out || fail "startup script not run: $(cat $T/client.out)"
+grep -q "forked IOC testioc: epicsEnvSet EPICS_MODULES '$T/modules'" $T/client.out || fail "environment not passed: $(cat $T/client.out)"
+
+kill $server
+echo "ok: fork server"
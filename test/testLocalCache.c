@@ -0,0 +1,118 @@
+/*
+* Local cache: directories are mirrored only without subdirectories, copies
+* follow sub-second mtime changes, the cache directory must be private,
+* and eviction removes only mirror directories no IOC uses.
+*/
+
+#include "../require.c"
+#include <sys/wait.h>
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (cond) printf("ok: " __VA_ARGS__); \
+    else { printf("FAIL: " __VA_ARGS__); failures++; } printf("\n"); } while (0)
+
+static char base[PATH_MAX];
+
+static void run(const char* format, ...)
+{
+    char command[PATH_MAX*4];
+    va_list ap;
+
+    va_start(ap, format);
+    vsnprintf(command, sizeof(command), format, ap);
+    va_end(ap);
+    if (system(command) != 0)
+    {
+        fprintf(stderr, "%s failed\n", command);
+        exit(2);
+    }
+}
+
+static int exists(const char* format, const char* arg)
+{
+    char path[PATH_MAX*2];
+    struct stat st;
+    snprintf(path, sizeof(path), format, base, arg);
+    return stat(path, &st) == 0;
+}
+
+int main(int argc, char** argv)
+{
+    char pooldir[PATH_MAX*2], cachedir[PATH_MAX*2], buffer[PATH_MAX*2], file[PATH_MAX*3];
+    char flatmirror[PATH_MAX*2];
+    const char* mirror;
+    struct stat poolstat, localstat;
+    pid_t pid;
+    int pipefd[2];
+    char c;
+
+    if (!realpath(argc > 1 ? argv[1] : "O.test", base)) return 2;
+    strcat(base, "/localcache");
+    run("rm -rf %s && mkdir -p %s/pool/flat %s/pool/nested/sub", base, base, base);
+    run("echo one > %s/pool/flat/a.template && echo two > %s/pool/nested/b.template", base, base);
+    snprintf(cachedir, sizeof(cachedir), "%s/public", base);
+    run("mkdir -m 755 %s", cachedir);
+
+    setenv("REQUIRE_LOCAL_CACHE", cachedir, 1);
+    CHECK(localCacheDir() == NULL, "refused cache directory with mode 0755");
+    snprintf(cachedir, sizeof(cachedir), "%s/link", base);
+    run("ln -s private %s && mkdir -m 700 %s/private", cachedir, base);
+    setenv("REQUIRE_LOCAL_CACHE", cachedir, 1);
+    CHECK(localCacheDir() == NULL, "refused symlink as cache directory");
+    snprintf(cachedir, sizeof(cachedir), "%s/cache", base);
+    setenv("REQUIRE_LOCAL_CACHE", cachedir, 1);
+    CHECK(localCacheDir() != NULL, "created private cache directory");
+
+    snprintf(pooldir, sizeof(pooldir), "%s/pool/flat", base);
+    mirror = localCacheDirectory(pooldir, buffer, sizeof(buffer));
+    CHECK(mirror != pooldir && strncmp(mirror, cachedir, strlen(cachedir)) == 0, "mirrored %s", mirror);
+    strcpy(flatmirror, mirror);
+    snprintf(file, sizeof(file), "%s/a.template", mirror);
+    CHECK(stat(file, &localstat) == 0, "copied a.template");
+
+    /* same size and second, other nanoseconds */
+    run("echo ONE > %s/pool/flat/a.template && touch -d '2020-01-01 00:00:00.2' %s/pool/flat/a.template", base, base);
+    localCacheDirectory(pooldir, buffer, sizeof(buffer));
+    run("echo one > %s/pool/flat/a.template && touch -d '2020-01-01 00:00:00.7' %s/pool/flat/a.template", base, base);
+    mirror = localCacheDirectory(pooldir, buffer, sizeof(buffer));
+    snprintf(pooldir, sizeof(pooldir), "%s/pool/flat/a.template", base);
+    stat(pooldir, &poolstat);
+    stat(file, &localstat);
+    CHECK(localstat.st_mtim.tv_nsec == poolstat.st_mtim.tv_nsec && localstat.st_mtim.tv_nsec != 0,
+        "copy updated after sub-second change");
+
+    snprintf(pooldir, sizeof(pooldir), "%s/pool/nested", base);
+    mirror = localCacheDirectory(pooldir, buffer, sizeof(buffer));
+    CHECK(mirror == pooldir, "not mirrored with subdirectory");
+
+    /* an unused mirror, one used by another IOC, and ours */
+    run("mkdir -m 700 %s/0000000000000001 %s/0000000000000002", cachedir, cachedir);
+    run("head -c 100000 /dev/zero > %s/0000000000000001/x", cachedir);
+    run("head -c 100000 /dev/zero > %s/0000000000000002/x", cachedir);
+    run("touch -d 2000-01-01 %s/0000000000000001 %s/0000000000000002", cachedir, cachedir);
+    if (pipe(pipefd) != 0) return 2;
+    fflush(stdout);
+    if ((pid = fork()) == 0)
+    {
+        snprintf(buffer, sizeof(buffer), "%s/0000000000000002", cachedir);
+        localCacheUse(buffer);
+        if (write(pipefd[1], "x", 1) != 1) exit(1);
+        sleep(5);
+        exit(0);
+    }
+    if (read(pipefd[0], &c, 1) != 1) return 2;
+    setenv("REQUIRE_LOCAL_CACHE_SIZE", "0", 1);
+    localCacheChanged = 1;
+    localCacheEvict();
+    CHECK(!exists("%s/cache/%s", "0000000000000001"), "evicted unused mirror");
+    CHECK(exists("%s/cache/%s", "0000000000000002"), "kept mirror used by other IOC");
+    snprintf(file, sizeof(file), "%s/a.template", flatmirror);
+    CHECK(stat(file, &localstat) == 0, "kept mirror used by this IOC");
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    localCacheChanged = 1;
+    localCacheEvict();
+    CHECK(!exists("%s/cache/%s", "0000000000000002"), "evicted mirror after other IOC has ended");
+    return failures != 0;
+}
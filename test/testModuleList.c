@@ -0,0 +1,117 @@
+/*
+* Module list: readers walk the list without locking while writers
+* append to it. Readers must always see complete entries in order,
+* and never lose an entry they have seen before.
+* Built with -fsanitize=thread, which also reports unordered accesses.
+*/
+
+#include "../require.c"
+#include <pthread.h>
+
+#define WRITERS 2
+#define READERS 4
+#define MODULES 2000  /* per writer */
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (cond) printf("ok: " __VA_ARGS__); \
+    else { printf("FAIL: " __VA_ARGS__); failures++; } printf("\n"); } while (0)
+
+static int writersDone;
+
+typedef struct readerState {
+    size_t seen[WRITERS];   /* entries of each writer seen in this walk */
+    int errors;
+} readerState;
+
+/* module "w<writer>m<number>" has version "<number>.<writer>" and must follow number-1 */
+static size_t checkEntry(const char* name, const char* version, const char* path, void* arg)
+{
+    readerState* r = arg;
+    unsigned int writer, number, vnumber, vwriter;
+
+    if (sscanf(name, "w%um%u", &writer, &number) != 2 || writer >= WRITERS ||
+        sscanf(version, "%u.%u", &vnumber, &vwriter) != 2 ||
+        vnumber != number || vwriter != writer || number != r->seen[writer])
+    {
+        if (r->errors++ == 0)
+            printf("inconsistent entry %s %s after %lu entries of writer %u\n",
+                name, version, (unsigned long)r->seen[writer % WRITERS], writer);
+        return 1;
+    }
+    r->seen[writer]++;
+    return 0;
+}
+
+static void* reader(void* arg)
+{
+    readerState* total = arg;
+    size_t before[WRITERS] = { 0 };
+    char name[32];
+    const char* version;
+    int i;
+
+    while (!__atomic_load_n(&writersDone, __ATOMIC_ACQUIRE))
+    {
+        readerState r = { { 0 }, 0 };
+
+        foreachLoadedLib(checkEntry, &r);
+        for (i = 0; i < WRITERS; i++)
+        {
+            /* the list only grows */
+            if (r.seen[i] < before[i]) r.errors++;
+            before[i] = r.seen[i];
+            /* the last entry seen is found by name */
+            if (r.seen[i] == 0) continue;
+            snprintf(name, sizeof(name), "w%dm%lu", i, (unsigned long)r.seen[i] - 1);
+            version = getLibVersion(name);
+            if (!version || (size_t)atol(version) != r.seen[i] - 1) r.errors++;
+        }
+        total->errors += r.errors;
+    }
+    return NULL;
+}
+
+static void* writer(void* arg)
+{
+    int w = (int)(long)arg;
+    char name[32], version[32];
+    int i;
+
+    for (i = 0; i < MODULES; i++)
+    {
+        snprintf(name, sizeof(name), "w%dm%d", w, i);
+        snprintf(version, sizeof(version), "%d.%d", i, w);
+        registerModule(name, version, NULL);
+    }
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    pthread_t writers[WRITERS], readers[READERS];
+    readerState states[READERS];
+    readerState r = { { 0 }, 0 };
+    int i, errors = 0;
+
+    memset(states, 0, sizeof(states));
+    for (i = 0; i < READERS; i++)
+        pthread_create(&readers[i], NULL, reader, &states[i]);
+    for (i = 0; i < WRITERS; i++)
+        pthread_create(&writers[i], NULL, writer, (void*)(long)i);
+    for (i = 0; i < WRITERS; i++)
+        pthread_join(writers[i], NULL);
+    __atomic_store_n(&writersDone, 1, __ATOMIC_RELEASE);
+    for (i = 0; i < READERS; i++)
+    {
+        pthread_join(readers[i], NULL);
+        errors += states[i].errors;
+    }
+
+    CHECK(errors == 0, "%d readers saw complete entries in order while %d writers appended", READERS, WRITERS);
+    foreachLoadedLib(checkEntry, &r);
+    CHECK(r.errors == 0 && r.seen[0] == MODULES && r.seen[1] == MODULES,
+        "all %d modules registered", WRITERS * MODULES);
+    CHECK(moduleCount == WRITERS * MODULES, "module count %lu", moduleCount);
+    return failures != 0;
+}
@@ -0,0 +1,314 @@
+/*
+* Pool cache: results and listings are shared between processes, become
+* outdated when a relevant version directory changes, and are never torn
+* while other processes write. Entries with names leading out of the
+* module directory and cache files others can write are refused.
+* IOCs booting in parallel from a pool generated with genPool.sh resolve
+* the same modules, and those booting later take them from the cache.
+*/
+
+#include "../require.c"
+#include <sys/wait.h>
+
+static int failures;
+
+#define CHECK(cond, ...) do { if (cond) printf("ok: " __VA_ARGS__); \
+    else { printf("FAIL: " __VA_ARGS__); failures++; } printf("\n"); } while (0)
+
+static char pool[PATH_MAX];
+static char moduledir[PATH_MAX];
+
+static void makeDir(const char* version, const char* sub)
+{
+    char path[PATH_MAX*2];
+    snprintf(path, sizeof(path), "mkdir -p %s%s/R%s/%s", moduledir, version, EPICSVERSION, sub);
+    if (system(path) != 0) exit(2);
+}
+
+static int lookup(const char* version, poolCacheResult* r)
+{
+    memset(r, 0, sizeof(*r));
+    return poolCacheLookup(moduledir, (int)strlen(moduledir), version, 0, r);
+}
+
+static void store(const char* version, const char* found, const char* relevant)
+{
+    poolCacheResult r = { 0 };
+    strcpy(r.found, found);
+    strcpy(r.relevant, relevant);
+    r.someVersionFound = r.someArchFound = 1;
+    poolCacheStore(moduledir, (int)strlen(moduledir), version, 0, &r);
+}
+
+static int listing(char* names, size_t size, int* cached)
+{
+    moduleDir* d = openModuleDir(-1, "mod", moduledir);
+    struct dirent* e;
+    int n = 0;
+
+    names[0] = 0;
+    if (!d) return -1;
+    *cached = d->dir == NULL;
+    while ((errno = 0, e = readModuleDir(d)) != NULL)
+    {
+        if (e->d_name[0] == '.') continue;
+        snprintf(names + strlen(names), size - strlen(names), " %s", e->d_name);
+        n++;
+    }
+    closeModuleDir(d);
+    return n;
+}
+
+static void testResults(void)
+{
+    poolCacheResult r;
+
+    CHECK(!lookup("1", &r), "miss before store");
+    store("1", "1.1", "1.0/1.1/2.0");
+    CHECK(lookup("1", &r) && strcmp(r.found, "1.1") == 0, "hit after store: \"%s\"", r.found);
+    CHECK(strcmp(r.relevant, "1.1/2.0") == 0, "lower versions are not relevant: \"%s\"", r.relevant);
+    CHECK(!lookup("2", &r), "miss for other version request");
+
+    /* a lower version gets our architecture: same result */
+    makeDir("1.0", "lib/other-arch");
+    CHECK(lookup("1", &r), "hit after change of a lower version");
+
+    /* a higher version gets our architecture: result may change */
+    makeDir("2.0", "lib/" T_A);
+    CHECK(!lookup("1", &r), "miss after change of a higher version");
+    store("1", "2.0", "2.0");
+    CHECK(lookup("1", &r) && strcmp(r.found, "2.0") == 0, "hit after new store: \"%s\"", r.found);
+
+    /* a new version */
+    makeDir("2.1", "");
+    CHECK(!lookup("1", &r), "miss after new version");
+
+    /* someone redirects to another directory */
+    store("1", "2.0", "2.0");
+    {
+        char key[512];
+        poolCacheResult bad = { 0 };
+        poolCacheKey(key, sizeof(key), moduledir, (int)strlen(moduledir), "1", 0);
+        strcpy(bad.found, "../other/1.0");
+        poolCacheWrite(key, &bad, sizeof(bad), poolCacheStamp(moduledir, (int)strlen(moduledir), ""));
+        CHECK(!lookup("1", &r), "refused found \"%s\"", bad.found);
+    }
+}
+
+static void testListing(void)
+{
+    char names[1024], names2[1024];
+    int cached;
+
+    CHECK(listing(names, sizeof(names), &cached) == 4 && !cached, "listing read:%s", names);
+    CHECK(listing(names2, sizeof(names2), &cached) == 4 && cached && strcmp(names, names2) == 0,
+        "listing from cache:%s", names2);
+    makeDir("3.0", "");
+    CHECK(listing(names, sizeof(names), &cached) == 5 && !cached, "listing after new version:%s", names);
+}
+
+/* writers store consistent values, readers must never see a mix */
+#define WRITERS 4
+#define READERS 4
+
+typedef struct { int a; char b[60]; int c; } testValue;
+
+static void writer(int id)
+{
+    testValue v;
+    int i;
+
+    for (i = 0; i < 200000; i++)
+    {
+        v.a = v.c = id * 1000000 + i;
+        snprintf(v.b, sizeof(v.b), "%d", v.a);
+        poolCacheWrite("concurrent", &v, sizeof(v), 1);
+    }
+    exit(0);
+}
+
+static void reader(void)
+{
+    testValue v;
+    unsigned long long stamp;
+    int i, hits = 0;
+
+    for (i = 0; i < 400000; i++)
+    {
+        if (!poolCacheRead("concurrent", &v, sizeof(v), &stamp)) continue;
+        hits++;
+        if (v.a != v.c || atoi(v.b) != v.a || stamp != 1)
+        {
+            printf("FAIL: torn read %d \"%s\" %d\n", v.a, v.b, v.c);
+            exit(1);
+        }
+    }
+    printf("ok: reader %d consistent hits\n", hits);
+    exit(0);
+}
+
+static void testConcurrent(void)
+{
+    pid_t pid;
+    int i, status, bad = 0;
+    testValue v = { 0 };
+    unsigned long long stamp;
+    poolCacheEntry* e;
+
+    fflush(stdout);
+    for (i = 0; i < WRITERS + READERS; i++)
+    {
+        if ((pid = fork()) == 0)
+        {
+            if (i < WRITERS) writer(i + 1);
+            reader();
+        }
+    }
+    while ((pid = wait(&status)) > 0)
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) bad++;
+    CHECK(!bad, "%d parallel writers and %d readers", WRITERS, READERS);
+
+    /* an entry left locked by a crashed writer */
+    fflush(stdout);
+    if ((pid = fork()) == 0) exit(0);
+    waitpid(pid, NULL, 0);
+    e = poolCacheGet()->entries + (poolCacheHash("concurrent") % (POOL_CACHE_SLOTS / POOL_CACHE_WAYS)) * POOL_CACHE_WAYS;
+    while (strcmp(e->key, "concurrent") != 0) e++;
+    e->lock = (unsigned int)pid << 1 | 1;
+    CHECK(!poolCacheRead("concurrent", &v, sizeof(v), &stamp), "locked entry is not read");
+    v.a = v.c = 42;
+    strcpy(v.b, "42");
+    poolCacheWrite("concurrent", &v, sizeof(v), 1);
+    CHECK(poolCacheRead("concurrent", &v, sizeof(v), &stamp) && v.a == 42, "entry of crashed writer taken over");
+}
+
+/* IOCs requiring m1 (and its dependencies) from a generated pool at the same time */
+#define IOCS 8
+
+static size_t printModule(const char* name, const char* version, const char* path, void* arg)
+{
+    fprintf(arg, "%s %s %s\n", name, version, path);
+    return 0;
+}
+
+static void requireChild(const char* cachefile, const char* resultfile)
+{
+    FILE* out;
+
+    if (!freopen("/dev/null", "w", stdout)) exit(2);
+    setenv("REQUIRE_POOL_CACHE", cachefile, 1);
+    if (require("m1", NULL, NULL) != 0) exit(1);
+    if ((out = fopen(resultfile, "w")) == NULL) exit(2);
+    foreachLoadedLib(printModule, out);
+    fprintf(out, "dir opens %lu\n", statsTotal[REQUIRE_STAT_DIR_OPEN]);
+    exit(fclose(out) != 0);
+}
+
+/* boot IOCS processes at once, compare their modules with expected (or set it),
+   return the largest number of module directories one of them had to read */
+static long requireWave(const char* cachefile, int wave, char* expected, size_t size)
+{
+    char resultfile[PATH_MAX*2];
+    char result[4096];
+    long opens, maxOpens = 0;
+    int i, status, bad = 0;
+    pid_t pid;
+
+    fflush(stdout);
+    for (i = 0; i < IOCS; i++)
+    {
+        snprintf(resultfile, sizeof(resultfile), "%s/result.%d.%d", pool, wave, i);
+        if (fork() == 0) requireChild(cachefile, resultfile);
+    }
+    while ((pid = wait(&status)) > 0)
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) bad++;
+    if (bad) return -1;
+    for (i = 0; i < IOCS; i++)
+    {
+        FILE* in;
+        size_t len;
+        char* p;
+
+        snprintf(resultfile, sizeof(resultfile), "%s/result.%d.%d", pool, wave, i);
+        if ((in = fopen(resultfile, "r")) == NULL) return -1;
+        len = fread(result, 1, sizeof(result) - 1, in);
+        fclose(in);
+        result[len] = 0;
+        if ((p = strstr(result, "dir opens ")) == NULL) return -1;
+        opens = atol(p + 10);
+        if (opens > maxOpens) maxOpens = opens;
+        *p = 0;
+        if (!expected[0]) snprintf(expected, size, "%s", result);
+        if (strcmp(result, expected) != 0)
+        {
+            printf("IOC %d of wave %d loaded\n%sinstead of\n%s", i, wave, result, expected);
+            return -1;
+        }
+    }
+    return maxOpens;
+}
+
+static void testParallelRequires(void)
+{
+    char command[PATH_MAX*3];
+    char cachefile[PATH_MAX*2];
+    char expected[4096] = "";
+    long opens;
+
+    snprintf(command, sizeof(command), "EPICSVERSION=%s T_A=%s ./genPool.sh %s/pool 8 3 2 2 2",
+        EPICSVERSION, T_A, pool);
+    if (system(command) != 0) exit(2);
+    setenv("EPICS_DRIVER_PATH", strcat(strcpy(command, pool), "/pool"), 1);
+    snprintf(cachefile, sizeof(cachefile), "%s/cache.requires", pool);
+
+    opens = requireWave(cachefile, 1, expected, sizeof(expected));
+    CHECK(opens > 0 && strstr(expected, "m8 1.3.0 ") != NULL,
+        "%d IOCs booting at once resolve the same modules", IOCS);
+    opens = requireWave(cachefile, 2, expected, sizeof(expected));
+    CHECK(opens == 0, "%d IOCs booting later resolve the same modules from the cache", IOCS);
+}
+
+static void testFileMode(const char* cachefile)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    if ((pid = fork()) == 0)
+    {
+        int fd = open(cachefile, O_RDWR|O_CREAT, 0600);
+        fchmod(fd, 0666);
+        close(fd);
+        setenv("REQUIRE_POOL_CACHE", cachefile, 1);
+        exit(poolCacheGet() != NULL);
+    }
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0, "refused cache file writable by others");
+}
+
+int main(int argc, char** argv)
+{
+    const char* dir = argc > 1 ? argv[1] : "O.test";
+    char cachefile[PATH_MAX*2];
+    char command[PATH_MAX*3];
+
+    if (!realpath(dir, pool)) return 2;
+    strcat(pool, "/poolcache");
+    snprintf(command, sizeof(command), "rm -rf %s", pool);
+    if (system(command) != 0) return 2;
+    snprintf(moduledir, sizeof(moduledir), "%s/mod/", pool);
+    makeDir("1.0", "lib/" T_A);
+    makeDir("1.1", "lib/" T_A);
+    makeDir("2.0", "lib/other-arch");
+    snprintf(cachefile, sizeof(cachefile), "%s/cache", pool);
+    strcat(cachefile, ".public");
+    testFileMode(cachefile); /* first, poolCacheGet() opens the file only once */
+    testParallelRequires();  /* in child processes, which open their own cache */
+
+    snprintf(cachefile, sizeof(cachefile), "%s/cache", pool);
+    setenv("REQUIRE_POOL_CACHE", cachefile, 1);
+    testResults();
+    testListing();
+    testConcurrent();
+    return failures != 0;
+}